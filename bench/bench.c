@@ -0,0 +1,370 @@
+/*
+ * Benchmarks of the tree's loading, insertion and search settings on one random data set
+ *
+ *   cc -std=c99 -O2 -I. -o rtree_bench bench/bench.c -lpthread -lm
+ *   ./rtree_bench [hilbert|split|nearest|fanout|link] [entries]
+ *
+ * Every mode builds its trees from the same entries and runs the same window queries.
+ * The tree's source is compiled in, so the benchmark can count the nodes a search reads.
+ * Fanouts past what a page holds are skipped; add -DRTPS=16384 to sweep them all.
+ */
+
+#include "rtree.c"
+#include <math.h>
+#include <time.h>
+
+#define EXTENT 1000000 /*entries lie in [0, EXTENT) on every axis*/
+#define SIDE 100       /*longest side of an entry*/
+#define WINDOW 10000   /*side of a query window*/
+#define QUERIES 2000
+#define NEAREST 10     /*K of the nearest neighbour queries*/
+#define WRITERS 8      /*most threads inserting into one RTSyncLink tree*/
+
+static struct RTEntry *Entries;
+static size_t Count; /*entries*/
+static RTdimension Queries[QUERIES][RTn*2];
+
+/*Run of the entries one writer thread inserts*/
+struct Share {
+   RTreePtr T;
+   size_t First, Last;
+};
+
+static double Now(void);
+static void MakeData(size_t n);
+static RTreePtr Build(const struct RTConfig *config, bool load, double *seconds);
+static double Windows(RTreePtr T, size_t *hits);
+static size_t Visits(struct RTNode *N, RTdimension S[]);
+static void Report(const char *name, const struct RTConfig *config, bool load);
+static void BenchHilbert(void);
+static void BenchSplit(void);
+static int CompareDistance(const void *a, const void *b);
+static size_t Around(RTreePtr T, RTdimension P[], RTdimension half, struct RTResults *results, long double distance[]);
+static double Expanding(RTreePtr T, RTdimension start, long double kth[]);
+static void BenchNearest(void);
+static void BenchFanout(void);
+static void *InsertShare(void *arg);
+static void BenchLink(void);
+
+/*Seconds on a monotonic clock*/
+static double Now(void) {
+   struct timespec t;
+
+   clock_gettime(CLOCK_MONOTONIC, &t);
+   return t.tv_sec + t.tv_nsec * 1e-9;
+}
+
+/*Random entries and query windows, the same on every run*/
+static void MakeData(size_t n) {
+   RTdimensionindex j;
+   size_t i;
+
+   srand(1);
+   Count = n;
+   Entries = (struct RTEntry *)malloc(n * sizeof(Entries[0]));
+   for (i = 0; i < n; ++i) {
+      Entries[i].Tuple = (void *)(i + 1);
+      for (j = 0; j < RTn; ++j) {
+         Entries[i].I[j] = rand() % EXTENT;
+         Entries[i].I[j+RTn] = Entries[i].I[j] + rand() % SIDE;
+      }
+   }
+
+   for (i = 0; i < QUERIES; ++i)
+      for (j = 0; j < RTn; ++j) {
+         Queries[i][j] = rand() % (EXTENT - WINDOW);
+         Queries[i][j+RTn] = Queries[i][j] + WINDOW;
+      }
+}
+
+/*Bulk loads the entries, or inserts them one at a time into an empty tree*/
+static RTreePtr Build(const struct RTConfig *config, bool load, double *seconds) {
+   RTreePtr T = NULL;
+   size_t i;
+   double start = Now();
+
+   if (load) {
+      if (!RTNewTreeArray(&T, Entries, Count, config))
+         exit(EXIT_FAILURE);
+   } else {
+      if (!RTNewTreeConfig(&T, NULL, config))
+         exit(EXIT_FAILURE);
+      for (i = 0; i < Count; ++i)
+         if (!RTInsertTuple(&T, Entries[i].I, Entries[i].Tuple))
+            exit(EXIT_FAILURE);
+   }
+
+   *seconds = Now() - start;
+   return T;
+}
+
+/*Runs every query window*/
+static double Windows(RTreePtr T, size_t *hits) {
+   size_t i, count;
+   double start = Now();
+
+   for (*hits = 0, i = 0; i < QUERIES; ++i) {
+      RTSelectCount(&T, Queries[i], &count);
+      *hits += count;
+   }
+
+   return Now() - start;
+}
+
+/*Child arrays a search reads: the root's, and those of every branch entry overlapping the window*/
+static size_t Visits(struct RTNode *N, RTdimension S[]) {
+   size_t visits = 1;
+   RTchildindex i;
+
+   if (IS_BRANCH(N))
+      for (i = 0; i < M && !IS_EMPTY(N->Child[i]); ++i)
+         if (Overlap(N->Child[i].I, S))
+            visits += Visits(N->Child+i, S);
+
+   return visits;
+}
+
+/*Builds a tree, searches it and prints one line*/
+static void Report(const char *name, const struct RTConfig *config, bool load) {
+   RTreePtr T;
+   size_t hits, visits, i;
+   double build, search;
+
+   T = Build(config, load, &build);
+   search = Windows(T, &hits);
+   for (visits = 0, i = 0; i < QUERIES; ++i)
+      visits += Visits(T->Root, Queries[i]);
+   printf("%-28s %s %8.3fs %8.0f/s   %d windows %8.3fs %8.1f nodes/window   %zu hits\n", name, load ? "load  " : "insert",
+      build, Count / build, QUERIES, search, (double)visits / QUERIES, hits);
+   RTFreeTree(&T);
+}
+
+/*Hilbert packing and Hilbert ordered insertion, against list order and STR packing and Guttman insertion*/
+static void BenchHilbert(void) {
+   struct RTConfig config;
+   RTdimensionindex j;
+
+   memset(&config, 0, sizeof(config));
+   config.Load = RTLoadList;
+   Report("list load", &config, true);
+   config.Load = RTLoadSTR;
+   Report("STR load", &config, true);
+   config.Fill = 0.7;
+   Report("STR load, Fill 0.7", &config, true);
+   config.Fill = 0;
+   config.Load = RTLoadHilbert;
+   Report("Hilbert load", &config, true);
+
+   memset(&config, 0, sizeof(config));
+   Report("Guttman insertion", &config, false);
+
+   config.Load = RTLoadHilbert;
+   config.Insert = RTInsertHilbert;
+   for (j = 0; j < RTn; ++j)
+      config.Bounds[j+RTn] = EXTENT + SIDE;
+   Report("Hilbert insertion", &config, false);
+}
+
+/*Each split behind Guttman insertion, and R* insertion with its own split*/
+static void BenchSplit(void) {
+   static const struct {const char *Name; enum RTSplit Split;} split[] = {
+      {"linear split", RTSplitLinear},
+      {"quadratic split", RTSplitQuadratic},
+      {"Greene split", RTSplitGreene},
+      {"R* split", RTSplitRStar}
+   };
+   struct RTConfig config;
+   size_t i;
+
+   for (i = 0; i < sizeof(split) / sizeof(split[0]); ++i) {
+      memset(&config, 0, sizeof(config));
+      config.Split = split[i].Split;
+      Report(split[i].Name, &config, false);
+   }
+
+   memset(&config, 0, sizeof(config));
+   config.Insert = RTInsertRStar;
+   Report("R* insertion", &config, false);
+}
+
+static int CompareDistance(const void *a, const void *b) {
+   long double x = *(const long double *)a, y = *(const long double *)b;
+
+   return (x > y) - (x < y);
+}
+
+/*Searches the window reaching half its side around a point and sorts the hits' distances from it*/
+static size_t Around(RTreePtr T, RTdimension P[], RTdimension half, struct RTResults *results, long double distance[]) {
+   RTdimension W[RTn*2];
+   RTdimensionindex j;
+   size_t i, count;
+
+   for (j = 0; j < RTn; ++j) {
+      W[j] = P[j] - half;
+      W[j+RTn] = P[j] + half;
+   }
+
+   RTSelectResults(&T, W, results, &count);
+   for (i = 0; i < count; ++i)
+      distance[i] = MinDist(P, results->Result[i].I, NULL, NULL);
+   qsort(distance, count, sizeof(distance[0]), CompareDistance);
+   return count;
+}
+
+/*K nearest neighbours by windows doubling from a start size until they hold K hits, then one window*/
+/*reaching as far as the K-th of those, which holds every entry nearer than it*/
+/*In: Tree, Half Side of the First Window  Out: Distance of each query's K-th neighbour*/
+static double Expanding(RTreePtr T, RTdimension start, long double kth[]) {
+   struct RTResults results = {0};
+   long double *distance = (long double *)malloc(Count * sizeof(distance[0]));
+   RTdimension P[RTn*2], half;
+   RTdimensionindex j;
+   size_t q;
+   double begin = Now();
+
+   for (q = 0; q < QUERIES; ++q) {
+      for (j = 0; j < RTn; ++j)
+         P[j] = P[j+RTn] = Queries[q][j];
+
+      for (half = start; Around(T, P, half, &results, distance) < NEAREST && half < EXTENT; half *= 2) ;
+      half = (RTdimension)ceill(sqrtl(distance[NEAREST-1]));
+      Around(T, P, half, &results, distance);
+      kth[q] = distance[NEAREST-1];
+   }
+
+   begin = Now() - begin;
+   RTFreeResults(&results);
+   free(distance);
+   return begin;
+}
+
+/*Best-first nearest neighbours against expanding windows started at, below and above the size the density suggests*/
+static void BenchNearest(void) {
+   static const struct {const char *Name; double Scale;} window[] = {
+      {"expanding window, tuned", 1},
+      {"expanding window, small", 1.0 / 8},
+      {"expanding window, large", 8}
+   };
+   struct RTResults results = {0};
+   struct RTConfig config;
+   RTdimension P[RTn*2], tuned;
+   RTdimensionindex j;
+   RTreePtr T;
+   long double best[QUERIES], kth[QUERIES];
+   size_t i, q, count, wrong;
+   double build, seconds;
+
+   memset(&config, 0, sizeof(config));
+   config.Load = RTLoadSTR;
+   T = Build(&config, true, &build);
+
+   seconds = Now();
+   for (q = 0; q < QUERIES; ++q) {
+      for (j = 0; j < RTn; ++j)
+         P[j] = P[j+RTn] = Queries[q][j];
+      RTSelectNearest(&T, P, NEAREST, &results, &count);
+      best[q] = results.Result[NEAREST-1].Distance;
+   }
+   seconds = Now() - seconds;
+   printf("%-28s %d queries of %d %8.3fs\n", "best first", QUERIES, NEAREST, seconds);
+
+   /*Half the side of a square holding K entries on average*/
+   tuned = (RTdimension)(EXTENT / 2 * sqrt((double)NEAREST / Count));
+   for (i = 0; i < sizeof(window) / sizeof(window[0]); ++i) {
+      seconds = Expanding(T, (RTdimension)(tuned * window[i].Scale) + 1, kth);
+      for (wrong = 0, q = 0; q < QUERIES; ++q)
+         wrong += kth[q] != best[q];
+      printf("%-28s %d queries of %d %8.3fs   %zu differ from best first\n", window[i].Name, QUERIES, NEAREST, seconds, wrong);
+   }
+
+   RTFreeResults(&results);
+   RTFreeTree(&T);
+}
+
+/*STR loading and Guttman insertion at fanouts from 8 to 256*/
+static void BenchFanout(void) {
+   struct RTConfig config;
+   char name[32];
+   RTchildindex fanout;
+
+   for (fanout = 8; fanout <= 256; fanout *= 2) {
+      if (fanout > M) {
+         printf("fanout %-21d skipped, a page holds %d children\n", (int)fanout, (int)M);
+         continue;
+      }
+
+      memset(&config, 0, sizeof(config));
+      config.Fanout = fanout;
+      config.Load = RTLoadSTR;
+      snprintf(name, sizeof(name), "fanout %d", (int)fanout);
+      Report(name, &config, true);
+      Report(name, &config, false);
+   }
+}
+
+static void *InsertShare(void *arg) {
+   struct Share *share = (struct Share *)arg;
+   size_t i;
+
+   for (i = share->First; i < share->Last; ++i)
+      if (!RTInsertTuple(&share->T, Entries[i].I, Entries[i].Tuple))
+         exit(EXIT_FAILURE);
+   return NULL;
+}
+
+/*Inserts every entry into one RTSyncLink tree from 1 to WRITERS threads, each taking an even share*/
+static void BenchLink(void) {
+   struct Share share[WRITERS];
+   pthread_t thread[WRITERS];
+   struct RTConfig config;
+   RTreePtr T = NULL;
+   char name[32];
+   size_t writers, i, hits;
+   double build, search;
+
+   memset(&config, 0, sizeof(config));
+   Report("RTSyncNone insertion", &config, false);
+
+   config.Sync = RTSyncLink;
+   for (writers = 1; writers <= WRITERS; writers *= 2) {
+      if (!RTNewTreeConfig(&T, NULL, &config))
+         exit(EXIT_FAILURE);
+
+      build = Now();
+      for (i = 0; i < writers; ++i) {
+         share[i].T = T;
+         share[i].First = STR_OFFSET(Count, writers, i);
+         share[i].Last = STR_OFFSET(Count, writers, i + 1);
+         pthread_create(&thread[i], NULL, InsertShare, share+i);
+      }
+      for (i = 0; i < writers; ++i)
+         pthread_join(thread[i], NULL);
+      build = Now() - build;
+
+      search = Windows(T, &hits);
+      snprintf(name, sizeof(name), "RTSyncLink, %zu writer%s", writers, writers > 1 ? "s" : "");
+      printf("%-28s insert %8.3fs %8.0f/s   %d windows %8.3fs   %zu hits\n", name, build, Count / build, QUERIES, search, hits);
+      RTFreeTree(&T);
+   }
+}
+
+int main(int argc, char *argv[]) {
+   const char *mode = argc > 1 ? argv[1] : "all";
+   bool all = !strcmp(mode, "all");
+
+   MakeData(argc > 2 ? (size_t)strtoul(argv[2], NULL, 10) : 200000);
+
+   if (all || !strcmp(mode, "hilbert"))
+      BenchHilbert();
+   if (all || !strcmp(mode, "split"))
+      BenchSplit();
+   if (all || !strcmp(mode, "nearest"))
+      BenchNearest();
+   if (all || !strcmp(mode, "fanout"))
+      BenchFanout();
+   if (all || !strcmp(mode, "link"))
+      BenchLink();
+
+   free(Entries);
+   return 0;
+}
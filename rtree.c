@@ -1,11 +1,46 @@
+#if defined(__unix__) || defined(__APPLE__)
+#ifndef _DEFAULT_SOURCE
+#define _DEFAULT_SOURCE     /*MAP_ANONYMOUS, madvise*/
+#endif
+#include <sys/mman.h> /*mmap, munmap, madvise*/
+#include <sched.h>    /*sched_yield*/
+#include <pthread.h>  /*pthread_create, pthread_join*/
+#include <unistd.h>   /*sysconf, close*/
+#include <fcntl.h>    /*open*/
+#include <sys/stat.h> /*fstat*/
+#define POOL_MMAP
+#define FILE_MMAP
+#define LATCH_YIELD
+#define LOAD_THREADS
+#endif
+
 #include <stdio.h>  /*fprintf, fputs*/
-#include <stdlib.h> /*malloc, free, NULL, exit*/
+#include <stdlib.h> /*malloc, realloc, free, NULL, exit*/
 #include <string.h> /*memcpy, memmove, memset*/
+#include <stddef.h> /*offsetof*/
 #include <float.h>  /*LDBL_MAX*/
 #include "rtree.h"
 
-#define m 2                        /*minimum children; sizeof childindex*/
-#define M (RTPS / sizeof(struct RTNode)) /*maximum children; sizeof childindex*/
+#define m 2                        /*default minimum children; sizeof childindex*/
+#ifdef RTREE_SOA
+#define M ((RTPS - sizeof(size_t)) / (sizeof(struct RTNode) + RTn*2*sizeof(RTdimension))) /*children a page holds; sizeof childindex*/
+#else
+#define M (RTPS / sizeof(struct RTNode)) /*children a page holds; sizeof childindex*/
+#endif
+
+#define MASK_WORDS ((M + 63) / 64) /*uint64_t words holding one bit per child*/
+
+/*RTSyncRCU and RTSyncLink need the GCC atomic builtins*/
+#ifdef __GNUC__
+#define RTREE_ATOMIC
+#endif
+#ifndef RTREE_ATOMIC
+#undef LOAD_THREADS /*loader threads share counters through the same builtins*/
+#endif
+#define LOAD_GRAIN 65536 /*fewest entries worth a loader thread; smaller loads stay on one*/
+#define RCU_READERS 256 /*readers inside an RTSyncRCU tree at once; more wait for a slot*/
+
+#define GRAIN ((RTdimension)0.5 == 0) /*1 for integer coordinates, whose boxes include their upper bound*/
 
 #define LEVEL_TOP -1
 #define LEVEL_LEAF 1
@@ -14,39 +49,642 @@
 #define IS_BRANCH(N) ((N)->Child && (N)->Child[0].Child && (N)->Child[0].Tuple == NULL)
 #define IS_LEAF(N)   ((N)->Child && (N)->Child[0].Tuple && (N)->Child[0].Child == NULL)
 #define IS_TUPLE(N)  ((N)->Tuple && (N)->Child == NULL)
-#define IS_EMPTY(N)  ((N).Parent == NULL) /* Will return true for root node */
+#define IS_EMPTY(N)  ((N).Child == NULL && (N).Tuple == NULL)
+
+/*R*-tree: smallest split group, entries forced out on overflow, children given the overlap test*/
+#define RSTAR_MIN(R) ((R)->Max * 2 / 5 > (R)->Min ? (R)->Max * 2 / 5 : (R)->Min)
+#define RSTAR_REINSERT(R) (((R)->Max + 1) * 3 / 10)
+#define RSTAR_CANDIDATES 32
+
+/*Offset of group g when n entries are spread evenly over P groups*/
+#define STR_OFFSET(n, P, g) ((g) * ((n) / (P)) + ((g) < (n) % (P) ? (g) : (n) % (P)))
 
 static struct RTNode {
-   struct RTNode *Parent;
    struct RTNode *Child;
    void *Tuple;
    RTdimension I[RTn*2]; /*{x1,y1,...,x2,y2...}*/
+#ifdef RTREE_COUNT
+   size_t Count;         /*entries below a branch or root; unused for entries of leaves*/
+#endif
+#ifdef RTREE_LHV
+   uint64_t LHV;         /*under Hilbert insertion, the largest Hilbert value below a branch or root, or an entry's own*/
+#endif
 } EMPTY_NODE = {
-   .Parent = NULL,
    .Child = NULL,
    .Tuple = NULL,
    .I = {0}
 };
 
+#ifdef RTREE_SOA
+/*Child array preceded by a dense copy of the child boxes, one array per side*/
+struct RTBlock {
+   size_t Count;
+   RTdimension Box[RTn*2][M];
+   struct RTNode Child[M];
+};
+
+#define BLOCK(N) ((struct RTBlock *)((char *)(N)->Child - offsetof(struct RTBlock, Child)))
+#define CHILD_BYTES sizeof(struct RTBlock)
+
+/*Vector kernels chosen at run time by CPU features*/
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define RTREE_SIMD
+#endif
+
+static void RangeMaskScalar(struct RTBlock *B, RTdimension X[], RTdimension Y[], uint64_t mask[]);
+#ifdef RTREE_SIMD
+static void RangeMaskResolve(struct RTBlock *B, RTdimension X[], RTdimension Y[], uint64_t mask[]);
+static void (*RangeMaskKernel)(struct RTBlock *B, RTdimension X[], RTdimension Y[], uint64_t mask[]) = RangeMaskResolve;
+/*Concurrent readers may resolve the kernel at once*/
+#define RANGE_MASK(B, X, Y, mask) __atomic_load_n(&RangeMaskKernel, __ATOMIC_RELAXED)(B, X, Y, mask)
+#else
+static void (*RangeMaskKernel)(struct RTBlock *B, RTdimension X[], RTdimension Y[], uint64_t mask[]) = RangeMaskScalar;
+#define RANGE_MASK(B, X, Y, mask) RangeMaskKernel(B, X, Y, mask)
+#endif
+#endif
+
+/*Child indexes count up to M+1, so narrow coordinates must not push M past RTchildindex*/
+typedef char FANOUT_FITS_CHILDINDEX[M + 1 < (RTchildindex)-1 ? 1 : -1];
+
+/*Entry forced out of an overflowing node, waiting to be inserted again*/
+struct Reinsert {
+   size_t Level;
+   struct RTNode Node;
+   struct Reinsert *Next;
+};
+
+#ifndef CHILD_BYTES
+#define CHILD_BYTES (M * sizeof(struct RTNode))
+#endif
+
+#define POOL_CHUNK ((size_t)2 << 20) /*bytes per pool chunk; one x86 huge page*/
+
+/*Memory a pool took from the system*/
+struct PoolChunk {
+   struct PoolChunk *Next;
+   void *Memory; /*as returned by the system*/
+   size_t Size;
+};
+
+/*Page sized child arrays carved from chunks; freed pages are linked through their first word*/
+struct Pool {
+   struct PoolChunk *Chunks;
+   void *Free;
+   char *Next, *End; /*pages of the newest chunk never handed out*/
+};
+
+/*Epoch a reader entered the tree in, 0 when free; a cache line each so readers don't share lines*/
+struct ReaderSlot {
+   uint64_t Epoch;
+   char Pad[64 - sizeof(uint64_t)];
+};
+
+/*Memory the writer replaced, freed once no reader can still hold it*/
+struct Retired {
+   struct Retired *Next;
+   uint64_t Epoch;     /*tree epoch when it was replaced*/
+   struct RTNode *Node;
+   bool Array;         /*a child array, or else a published root*/
+};
+
+/*Where an entry lives: the child array and slot of its leaf, or for a child array those of the node holding it*/
+struct Home {
+   const void *Key;      /*Tuple or child array; NULL for a free slot*/
+   struct RTNode *Child;
+   RTchildindex Slot;    /*where it was put; entries shifted within the array leave it stale*/
+};
+
+/*Open addressing hash of homes, probed linearly*/
+struct HomeTable {
+   struct Home *Slot;
+   size_t Count;
+   size_t Size;          /*a power of 2, or 0 while empty*/
+};
+
+/*RTSyncLink node header, kept after the children of every child array*/
+struct Link {
+   uint64_t Version;     /*odd while a writer holds the node*/
+   uint64_t NSN;         /*tree sequence number of the node's last split*/
+   struct RTNode *Right; /*node split off by that split*/
+};
+
+#define LINK(Child) ((struct Link *)((Child) + M))
+
+struct RTree {
+   struct RTNode *Root;      /*the writer's root*/
+   struct RTConfig Config;
+   struct Pool Pool;
+   struct RTAllocStats Stats;
+   uint64_t Reinserted;      /*levels that already forced a reinsert during this operation*/
+   struct Reinsert *Pending; /*entries forced out, closest to their old node first*/
+   RTchildindex Max;         /*most children per node, M of the paper; at most the page's M*/
+   RTchildindex Min;         /*fewest children per node but the root, m of the paper*/
+   struct RTNode *Published; /*copy of the root readers start from; NULL unless RTSyncRCU*/
+   uint64_t Epoch;           /*advanced by the writer once every reader inside has entered in it*/
+   struct ReaderSlot *Readers;
+   struct Retired *Retired;  /*newest first*/
+   struct RTNode **Fresh;    /*child arrays allocated since the last publish, which no reader can see*/
+   size_t FreshCount;
+   size_t FreshCapacity;
+   uint64_t Latch;           /*RTSyncLink: version of Root and Height*/
+   uint64_t Sequence;        /*RTSyncLink: last node sequence number handed out*/
+   size_t Height;            /*RTSyncLink: levels of child arrays*/
+   bool Loading;             /*loader threads are allocating child arrays at once*/
+   uint64_t PoolLatch;       /*held around the pool while Loading*/
+   struct HomeTable Tuples;  /*Config.Index: leaf of each Tuple*/
+   struct HomeTable Arrays;  /*Config.Index: node holding each child array but the root's*/
+};
+
+#define MAX_HEIGHT 64 /*levels; at least m children per node keeps trees far lower*/
+
+/*Root to node path carried by writers in place of parent pointers*/
+struct Path {
+   size_t Depth;
+   struct RTNode *Node[MAX_HEIGHT]; /*Node[0] is the root*/
+};
+
+#define PARENT(path, d) ((d) > 0 ? (path)->Node[(d)-1] : NULL) /*parent of the node at depth d*/
+
+/*Explicit traversal stack, root first*/
+struct SearchPath {
+   size_t Depth;
+   struct {
+      struct RTNode *Node;
+      uint64_t Mask[MASK_WORDS]; /*children left to visit*/
+      bool Within;               /*the node lies within the search box, so every entry below it is a hit*/
+   } Stack[MAX_HEIGHT];
+};
+
+/*Entries an R-link traversal copied from a node*/
+struct LinkNode {
+   struct RTNode Child[M];
+   RTchildindex Count;
+   uint64_t Version;     /*of the node when copied*/
+   uint64_t Expect;      /*tree sequence number the copy was read at*/
+   struct RTNode *Right; /*node split off since the parent was read, NULL if none*/
+   struct RTNode *From;  /*the child array copied*/
+};
+
+/*Child array an R-link traversal still has to read, with the sequence number its parent was read at*/
+struct LinkWait {
+   struct RTNode *Child;
+   uint64_t Expect;
+};
+
+/*R-link traversal stack; readers hold no latch between reads*/
+struct LinkPath {
+   struct LinkWait *Wait;
+   size_t Count;
+   size_t Capacity;
+   struct LinkNode Node; /*last node read*/
+   RTchildindex Next;    /*first hit of Node not yet visited*/
+};
+
+struct RTCursor {
+   RTdimension S[RTn*2];
+   struct SearchPath Path;
+   struct RTree *Tree;
+   size_t Slot;           /*reader slot held while open*/
+   struct LinkPath *Link; /*RTSyncLink traversal in place of Path*/
+};
+
+/*Entry waiting in a nearest neighbour queue*/
+struct NearEntry {
+   long double Key;     /*distance from the query*/
+   struct RTNode *Node; /*a hit when it has no children*/
+   uint64_t Expect;     /*RTSyncLink: tree sequence number the entry was read at*/
+};
+
+/*RTSyncLink: node copies queued entries point into*/
+struct NearBlock {
+   struct NearBlock *Next;
+   struct LinkNode Node;
+   struct RTNode Right; /*entry for the node split off, with the box of the one it left*/
+};
+
+struct RTNearest {
+   RTdimension P[RTn*2];
+   RTDistance Distance; /*NULL for MinDist*/
+   void *ctx;
+   struct NearEntry *Queue; /*binary min heap on Key*/
+   size_t Count;
+   size_t Capacity;
+   long double *Best; /*max heap of the Limit nearest hit distances queued; farther entries are dropped*/
+   size_t Limit;      /*0 browses without a bound*/
+   size_t Kept;
+   struct RTree *Tree;
+   size_t Slot; /*reader slot held while open*/
+   struct NearBlock *Blocks;
+};
+
+/*Visitor context for RTFetchCursor and RTSelectResults, which also take leaves within the search box whole*/
+struct CursorFetch {
+   struct RTResults *results;
+   size_t limit;
+};
+
+/*Visitor context building the RTSelectTuple results*/
+struct SelectList {
+   struct RTNodeList **list;
+   size_t count;
+};
+
+/*Tasks shared by the loader threads; each takes the next task until none are left*/
+struct LoadJob {
+   bool (*Run)(void *ctx, size_t task);
+   void *Ctx;
+   size_t Tasks;
+   size_t Next;
+   bool Failed;
+};
+
+/*Copies entries to load and covers each chunk of them*/
+struct LoadEntries {
+   const struct RTEntry *From; /*NULL when the entries are already copied*/
+   struct RTNode *E;
+   size_t n;
+   size_t Tasks;
+   RTdimension (*Cover)[RTn*2]; /*one per task*/
+};
+
+/*Sort keys for one dimension of the entries, or their Hilbert values*/
+struct LoadKeys {
+   const struct RTree *R;
+   struct RTNode *E;
+   long double *key;
+   size_t n;
+   size_t Tasks;
+   RTdimensionindex Dim; /*RTn for Hilbert values*/
+};
+
+/*Sample sort: entries are dealt into key ranges by chunk, then each range is sorted on its own*/
+struct LoadSort {
+   struct RTNode *E, *NE;
+   long double *key, *nkey;
+   size_t n;
+   size_t Chunks;
+   size_t Buckets;
+   long double *Split;  /*Buckets-1 splitters, ascending*/
+   uint32_t *Bucket;    /*bucket of each entry*/
+   size_t *Offset;      /*Chunks*Buckets counts, then where each chunk writes each bucket*/
+   size_t *Start;       /*Buckets+1 bucket offsets*/
+};
+
+/*Groups packed into nodes, a run of groups per task*/
+struct LoadPack {
+   struct RTree *R;
+   struct RTNode *E;
+   size_t n;
+   size_t P;
+   size_t Tasks;
+   struct RTNode *out;
+};
+
+/*STR slabs tiled on their own once the first dimension is sorted*/
+struct LoadSlabs {
+   struct RTree *R;
+   struct RTNode *E;
+   long double *key;
+   size_t n;
+   size_t P;
+   size_t *First; /*first group of each slab, and one past the last*/
+   struct RTNode *out;
+};
+
+#define BATCH_GROUP 64 /*queries of a batch searched together; one bit each of a uint64_t*/
+#define BATCH_FRESH 256 /*child arrays an RTSyncRCU batch writes before publishing them; IsFresh scans them all*/
+
+/*Subtree a batch group still has to search, with the queries of the group overlapping it*/
+struct BatchEntry {
+   struct RTNode *Node;
+   uint64_t Queries;
+};
+
+/*Queries of RTSelectBatch, ordered so each group of BATCH_GROUP lies close together*/
+struct Batch {
+   struct RTree *R;
+   RTdimension (*S)[RTn*2];
+   RTVisitor visit;
+   void **ctx;
+   struct RTResults *results; /*one per query when visit is NULL*/
+   struct RTNode *E;          /*query boxes in Hilbert order, each Tuple pointing at its box in S*/
+   size_t n;
+};
+
+#define JOIN_TASKS 8 /*pairs of subtrees a parallel join hands each thread, to even out their work*/
+
+/*Pair of subtrees of a join, one from each tree, with their levels; leaves are LEVEL_LEAF*/
+struct JoinPair {
+   struct RTNode *A;
+   struct RTNode *B;
+   size_t LevelA;
+   size_t LevelB;
+};
+
+/*Join of two trees; the pairs are split among threads a task each*/
+struct Join {
+   RTJoinVisitor visit;
+   void *ctx;
+   struct JoinPair *Pair;
+   size_t n;
+   bool Stopped; /*set once the visitor returns false*/
+};
+
+/*Visitor context for joins that probe one tree with each entry of the other*/
+struct JoinProbe {
+   struct Join *J;
+   struct RTree *B;
+   RTdimension *I; /*entry of the outer tree*/
+   void *Tuple;
+};
+
+/*Visitor context for LinkLocate*/
+struct LinkFind {
+   RTdimension *I;
+   void *Tuple;
+   bool found;
+};
+
+/*Saved trees hold no pointers: nodes refer to their children by offset from the start of the file*/
+#define MAP_MAGIC "RTreeMap"
+#define MAP_VERSION 1
+#define MAP_ORDER 0x01020304u /*reads back differently on machines of the other byte order*/
+#define MAP_INTEGER 0x100     /*set in Coordinate for integer coordinates*/
+
+/*Start of a saved tree; nodes follow from the root down, a level at a time*/
+struct MapHeader {
+   char Magic[8];
+   uint32_t Version;
+   uint32_t Order;
+   uint32_t Dimensions;  /*RTn*/
+   uint32_t Coordinate;  /*sizeof(RTdimension), and MAP_INTEGER*/
+   uint64_t Size;        /*bytes in the file*/
+   uint64_t Nodes;
+   uint64_t Entries;
+   uint64_t Height;      /*levels of nodes*/
+   uint64_t Root;        /*offset of the root node*/
+   RTdimension I[RTn*2]; /*cover of every entry*/
+};
+
+/*Saved node; Count entries follow it*/
+struct MapNode {
+   uint32_t Count;
+   uint32_t Leaf;
+};
+
+/*Saved entry*/
+struct MapEntry {
+   uint64_t Ref; /*offset of the child node in branches, tuple id in leaves*/
+   RTdimension I[RTn*2];
+};
+
+struct RTMapped {
+   const unsigned char *Base;
+   size_t Size;
+   bool Mapped; /*false when read into memory*/
+};
+
+/*Paged trees keep their nodes in RTPS pages of a file, read and written through a pool of frames*/
+#define PAGE_MAGIC "RTreePag"
+#define PAGE_VERSION 1
+#define PAGE_MAX ((RTPS - sizeof(struct PageNode)) / sizeof(struct MapEntry)) /*entries a page holds*/
+#define PAGE_MIN (PAGE_MAX * 2 / 5)  /*fewest entries of a page but the root*/
+#define PAGE_FRAMES 16               /*fewest frames; every page on a root to leaf path stays pinned at once*/
+
+/*Page 0 of a paged tree*/
+struct PageHeader {
+   char Magic[8];
+   uint32_t Version;
+   uint32_t Order;      /*MAP_ORDER*/
+   uint32_t Dimensions; /*RTn*/
+   uint32_t Coordinate; /*sizeof(RTdimension), and MAP_INTEGER*/
+   uint64_t PageSize;   /*RTPS*/
+   uint64_t Pages;      /*pages in the file, this one among them*/
+   uint64_t Root;       /*page of the root*/
+   uint64_t Height;     /*levels of pages*/
+   uint64_t Free;       /*first page of the free list, 0 if none*/
+   uint64_t Entries;
+};
+
+/*Node page; Count entries follow it*/
+struct PageNode {
+   uint32_t Count;
+   uint32_t Leaf;
+   uint64_t Next; /*next page of the free list while the page is free*/
+};
+
+/*Buffer pool frame*/
+struct PageFrame {
+   uint64_t Page;  /*0 while empty*/
+   size_t Next;    /*next frame of the same hash bucket; Frames ends the chain*/
+   unsigned Pins;
+   bool Dirty;
+   bool Used;      /*clock reference bit*/
+};
+
+struct RTPaged {
+   struct PageHeader Header;
+#ifdef FILE_MMAP
+   int File;
+#else
+   FILE *File;
+#endif
+   unsigned char *Data;     /*one page per frame*/
+   struct PageFrame *Frame;
+   size_t Frames;
+   size_t *Bucket;          /*first frame of each hash bucket*/
+   size_t Buckets;          /*a power of two*/
+   size_t Hand;             /*clock hand*/
+   struct RTPageStats Stats;
+};
+
+/*Entry taken out of an underfull page, waiting to go back in at its level*/
+struct PageOrphan {
+   struct MapEntry E;
+   uint64_t Level; /*of the page it goes into, leaves being 0*/
+};
+
+static const struct RTConfig DEFAULT_CONFIG = {
+   .Load = RTLoadSTR,
+   .Fill = 1.0,
+   .Insert = RTInsertGuttman,
+   .Split = RTSplitDefault
+};
+
+/*Bits per dimension of the Hilbert curve; keys stay exact as long double sort keys*/
+#define HILBERT_BITS ((LDBL_MANT_DIG < 64 ? LDBL_MANT_DIG : 64) / RTn)
+#define HILBERT_MAX ((uint64_t)-1 >> (64 - HILBERT_BITS))
+
 static void *mem_alloc(size_t _Size);
+static void *mem_realloc(void *_Memory, size_t _NewSize);
 
 static bool Overlap(RTdimension *S1, RTdimension *S2);
 static bool Within(RTdimension *S1, RTdimension *S2);
 static long double safe_multiply(long double left, long double right);
 static long double Volume(RTdimension *S);
+static long double Margin(RTdimension *S);
+static long double Intersection(RTdimension *S1, RTdimension *S2);
+
+static bool PackNode(struct RTree *R, struct RTNode *node, struct RTNode *E, RTchildindex count);
+static bool FillNode(struct RTNode *node, struct RTNode *E, RTchildindex count);
+static void SortNodes(struct RTNode *E, long double *key, size_t n);
+static size_t STRSlabs(size_t count, RTdimensionindex j);
+static bool STRTile(struct RTree *R, struct RTNode *E, long double *key, size_t n, size_t P, size_t g, size_t count, RTdimensionindex j, struct RTNode *out);
+static bool PackLoad(struct RTree *R, struct RTNode **T, struct RTNode *E, size_t n, RTchildindex b);
+static bool LoadTree(RTreePtr *T, struct RTNode *E, const struct RTEntry *entries, size_t n, const struct RTConfig *config);
+
+static size_t LoadThreads(const struct RTree *R, size_t n);
+static size_t LoadChunks(const struct RTree *R, size_t n);
+static void LoadWork(struct LoadJob *job);
+static bool LoadRun(struct RTree *R, bool (*run)(void *ctx, size_t task), void *ctx, size_t tasks, size_t n);
+static bool TaskRun(bool (*run)(void *ctx, size_t task), void *ctx, size_t tasks, size_t threads);
+static bool LoadEntriesTask(void *ctx, size_t task);
+static bool LoadKeysTask(void *ctx, size_t task);
+static bool LoadCountTask(void *ctx, size_t task);
+static bool LoadScatterTask(void *ctx, size_t task);
+static bool LoadBucketTask(void *ctx, size_t task);
+static bool LoadPackTask(void *ctx, size_t task);
+static bool LoadSlabTask(void *ctx, size_t task);
+static int LoadCompare(const void *a, const void *b);
+static void LoadKeysRun(struct RTree *R, struct RTNode *E, long double *key, size_t n, RTdimensionindex dim);
+static void LoadSortRun(struct RTree *R, struct RTNode **E, long double **key, size_t n);
+static bool LoadPackRun(struct RTree *R, struct RTNode *E, size_t n, size_t P, struct RTNode *out);
+
+static RTchildindex CountChildren(struct RTNode *N);
+static bool PlaceEntry(struct RTNode *N, RTchildindex pos, struct RTNode *E);
+
+static uint64_t HilbertKey(const struct RTree *R, RTdimension *S);
+static uint64_t HilbertLHV(const struct RTree *R, struct RTNode *N);
+static RTchildindex HilbertSearch(const struct RTree *R, struct RTNode *N, uint64_t h);
+static bool HilbertChooseLeaf(const struct RTree *R, struct Path *path, size_t Start, size_t Stop, uint64_t h);
+static bool HilbertSplit(struct RTree *R, struct RTNode *P, struct RTNode *L, struct RTNode *E, uint64_t h, struct RTNode **split);
+static bool HilbertReorder(const struct RTree *R, struct RTNode *L, RTchildindex pos);
 
 static bool InitNodes(struct RTNode *ptr, RTchildindex size);
-static bool FreeNodes(struct RTNode *T);
-
-static bool Search(struct RTNode *T, RTdimension S[], struct RTNodeList **list, size_t *count);
-static bool Insert(struct RTNode **N, size_t Level, RTdimension I[], void *Tuple, struct RTNode *Branch);
-static bool ChooseLeaf(struct RTNode *N, size_t Start, size_t Stop, RTdimension *I, struct RTNode **leaf);
-static bool AdjustTree(struct RTNode *N, struct RTNode *NN, struct RTNode **root, struct RTNode **split);
-static bool Delete(struct RTNode **T, RTdimension I[], void *Tuple);
-static bool FindLeaf(struct RTNode *T, RTdimension I[], void *Tuple, struct RTNode **L, RTchildindex *position);
-static bool CondenseTree(struct RTNode *N, struct RTNode **root);
-static bool LinearSplit(struct RTNode *L, RTdimension I[], void *Tuple, struct RTNode *Child, struct RTNode **split);
-static bool LinearPickSeeds(struct RTNode NL[], long double *width, struct RTNode **hbest, struct RTNode **lbest);
+static struct RTNode *NewChildren(struct RTree *R);
+static void FreeChildren(struct RTree *R, struct RTNode *Child);
+static void *PoolAlloc(struct RTree *R);
+static void PoolRelease(struct RTree *R);
+static void SyncNode(struct RTNode *N);
+
+static struct RTNode *ReadLock(struct RTree *R, size_t *slot);
+static void ReadUnlock(struct RTree *R, size_t slot);
+static bool IsFresh(const struct RTree *R, struct RTNode *Child);
+static void Shadow(struct RTree *R, struct RTNode *N);
+static void ShadowPath(struct RTree *R, struct Path *path);
+static void DropChildren(struct RTree *R, struct RTNode *Child);
+static void Retire(struct RTree *R, struct RTNode *N, bool array);
+static void Reclaim(struct RTree *R, uint64_t epoch);
+static void Publish(struct RTree *R);
+
+static uint64_t LatchRead(uint64_t *latch);
+static bool LatchCheck(uint64_t *latch, uint64_t version);
+static void LatchLock(uint64_t *latch);
+static void LatchUnlock(uint64_t *latch);
+static uint64_t LinkSequence(struct RTree *R);
+static uint64_t LinkRoot(struct RTree *R, struct RTNode *root);
+static void LinkRead(struct RTree *R, struct RTNode *Child, uint64_t expect, RTdimension S[], void (*pick)(struct RTNode *T, RTdimension S[], uint64_t mask[]), struct LinkNode *out);
+static void LinkPush(struct LinkPath *path, struct RTNode *Child, uint64_t expect);
+static void LinkOpen(struct RTree *R, struct LinkPath *path);
+static bool LinkResume(struct RTree *R, struct LinkPath *path, RTdimension S[], void (*pick)(struct RTNode *T, RTdimension S[], uint64_t mask[]), RTVisitor visit, void *ctx);
+static bool LinkSearch(struct RTree *R, RTdimension S[], RTVisitor visit, void *ctx);
+static bool LinkFindVisitor(RTdimension I[], void *Tuple, void *ctx);
+static bool LinkLocate(struct RTree *R, RTdimension I[], void *Tuple, struct RTNode **leaf, RTchildindex *position);
+static void LinkSplit(struct RTree *R, struct RTNode *L, struct RTNode *LL);
+static void LinkRelease(struct RTree *R, struct RTNode *held[], size_t n, bool rooted);
+static bool LinkInsert(struct RTree *R, RTdimension I[], void *Tuple);
+static bool LinkDelete(struct RTree *R, RTdimension I[], void *Tuple);
+static bool LinkUpdate(struct RTree *R, RTdimension I[], void *Tuple, void *New, RTdimension Size[]);
+
+static void OverlapMask(struct RTNode *T, RTdimension S[], uint64_t mask[]);
+static void ContainMask(struct RTNode *T, RTdimension I[], uint64_t mask[]);
+static void ChildMask(struct RTNode *T, uint64_t mask[]);
+static bool SearchMask(struct RTNode *T, RTdimension S[], bool within, uint64_t mask[]);
+static RTchildindex NextChild(uint64_t mask[]);
+static bool FreeNodes(struct RTree *R, struct RTNode *T);
+
+static bool SelectListVisitor(RTdimension I[], void *Tuple, void *ctx);
+static bool SelectResultsVisitor(RTdimension I[], void *Tuple, void *ctx);
+static bool CursorFetchVisitor(RTdimension I[], void *Tuple, void *ctx);
+static void TakeEntries(struct CursorFetch *fetch, struct RTNode *E, size_t n);
+static long double MinDist(RTdimension P[], RTdimension I[], void *Tuple, void *ctx);
+static long double NearKey(struct RTNearest *C, struct RTNode *E);
+static void NearExpand(struct RTNearest *C, struct RTNode *N, uint64_t Expect);
+static void NearPush(struct RTNearest *C, long double Key, struct RTNode *N, uint64_t Expect);
+static void NearBound(struct RTNearest *C, long double Key);
+static struct RTNode *NearPop(struct RTNearest *C, long double *Key, uint64_t *Expect);
+static bool SearchTree(struct RTree *R, RTdimension S[], RTVisitor visit, void *ctx, struct CursorFetch *fetch);
+static bool Search(struct RTNode *T, RTdimension S[], RTVisitor visit, void *ctx, struct CursorFetch *fetch);
+static bool CountSearch(struct RTNode *T, RTdimension S[], size_t *count);
+static bool Resume(struct SearchPath *path, RTdimension S[], RTVisitor visit, void *ctx, struct CursorFetch *fetch);
+static bool BatchTask(void *ctx, size_t task);
+static void BatchSearch(struct Batch *B, struct RTNode *T, const size_t Q[], size_t count);
+static bool BatchVisit(struct Batch *B, size_t q, RTdimension I[], void *Tuple);
+static unsigned NextBit(uint64_t *word);
+static bool JoinTrees(struct RTree *A, struct RTree *B, RTJoinVisitor visit, void *ctx, size_t threads);
+static bool JoinTask(void *ctx, size_t task);
+static bool JoinExpand(struct Join *J, const struct JoinPair *P, struct JoinPair **list, size_t *n, size_t *capacity);
+static bool JoinMeet(struct Join *J, struct RTNode *A, struct RTNode *B, size_t level, struct JoinPair **list, size_t *n, size_t *capacity);
+static void JoinPush(struct RTNode *A, struct RTNode *B, size_t LevelA, size_t LevelB, struct JoinPair **list, size_t *n, size_t *capacity);
+static int JoinCompare(const void *a, const void *b);
+static bool JoinStopped(struct Join *J);
+static bool JoinOuterVisitor(RTdimension I[], void *Tuple, void *ctx);
+static bool JoinInnerVisitor(RTdimension I[], void *Tuple, void *ctx);
+static const struct MapNode *MapNodeAt(const struct RTMapped *T, uint64_t offset);
+static void MapRelease(const struct RTMapped *T);
+static void PageRelease(struct RTPaged *T);
+static bool PageIO(struct RTPaged *T, uint64_t page, void *buf, bool write);
+static size_t PageFind(struct RTPaged *T, uint64_t page);
+static size_t PageFrameFor(struct RTPaged *T, uint64_t page);
+static struct PageNode *PagePin(struct RTPaged *T, uint64_t page);
+static struct PageNode *PageAlloc(struct RTPaged *T, uint64_t *page);
+static void PageUnpin(struct RTPaged *T, struct PageNode *N, bool dirty);
+static void PageDrop(struct RTPaged *T, struct PageNode *N, uint64_t page);
+static bool PageFlush(struct RTPaged *T);
+static void PageCover(const struct PageNode *N, RTdimension I[]);
+static bool PageInsert(struct RTPaged *T, const struct MapEntry *E, uint64_t level);
+static bool PageSplit(struct RTPaged *T, struct PageNode *N, const struct MapEntry *E, struct MapEntry *split);
+static bool PageDelete(struct RTPaged *T, RTdimension I[], uint64_t Id);
+static bool Insert(struct RTree *R, struct RTNode **N, size_t Level, RTdimension I[], void *Tuple, struct RTNode *Branch);
+static bool ChooseLeaf(const struct RTree *R, struct Path *path, size_t Start, size_t Stop, RTdimension *I);
+static struct RTNode *ChooseSubtree(const struct RTree *R, struct RTNode *N, RTdimension *I, bool last);
+static struct RTNode *RStarChooseSubtree(struct RTNode *N, RTdimension *I);
+static bool AdjustTree(struct RTree *R, struct Path *path, struct RTNode *NN, struct RTNode **split);
+static bool Delete(struct RTree *R, RTdimension I[], void *Tuple);
+static void ShortenTree(struct RTree *R);
+static struct RTNode *BatchOrder(struct RTree *R, const struct RTEntry entries[], size_t count);
+static bool InsertGroup(struct RTree *R, struct RTNode E[], size_t n, size_t *used);
+static bool DeleteGroup(struct RTree *R, struct RTNode E[], size_t n, size_t *used, size_t *deleted);
+static bool FindLeaf(struct RTNode *T, RTdimension I[], void *Tuple, struct Path *leaf, RTchildindex *position);
+static bool HomeLeaf(struct RTree *R, RTdimension I[], void *Tuple, struct Path *leaf, RTchildindex *position);
+static size_t HomeProbe(const struct HomeTable *X, const void *key);
+static struct Home *HomeFind(const struct HomeTable *X, const void *key);
+static void HomeSet(struct HomeTable *X, const void *key, struct RTNode *Child, RTchildindex slot);
+static void HomeDrop(struct HomeTable *X, const void *key, const struct RTNode *Child);
+static void HomeEntries(struct RTree *R, struct RTNode *Child, RTchildindex from, RTchildindex to);
+static void HomeTree(struct RTree *R, struct RTNode *N);
+static bool CondenseTree(struct RTree *R, struct Path *path);
+static bool LinearSplit(struct RTree *R, struct RTNode *L, struct RTNode NL[], struct RTNode **split);
+static bool LinearPickSeeds(struct RTNode NL[], RTchildindex count, long double *width, struct RTNode **hbest, struct RTNode **lbest);
+static size_t NodeLevel(struct RTNode *N);
+static bool OverflowTreatment(struct RTree *R, struct RTNode *P, struct RTNode *L, RTdimension I[], void *Tuple, struct RTNode *Child, struct RTNode **split);
+static bool Reinsert(struct RTree *R, struct RTNode *L, struct RTNode NL[], size_t level);
+static bool ReinsertPending(struct RTree *R);
+static bool QuadraticSplit(struct RTree *R, struct RTNode *L, struct RTNode NL[], struct RTNode **split);
+static void QuadraticPickSeeds(struct RTNode NL[], RTchildindex n, RTchildindex *seedA, RTchildindex *seedB);
+static bool RStarSplit(struct RTree *R, struct RTNode *L, struct RTNode NL[], struct RTNode **split);
+static bool GreeneSplit(struct RTree *R, struct RTNode *L, struct RTNode NL[], struct RTNode **split);
+static bool SplitGroups(struct RTree *R, struct RTNode *L, struct RTNode NL[], bool group[], struct RTNode **split);
+static void CoverEntries(struct RTNode NL[], RTchildindex n, RTdimension front[][RTn*2], RTdimension back[][RTn*2]);
+static long double Enlargement(RTdimension *S, RTdimension *E);
+
+/*Split algorithms by RTSplit; RTNewTreeConfig resolves RTSplitDefault*/
+static bool (*const SPLIT[])(struct RTree *R, struct RTNode *L, struct RTNode NL[], struct RTNode **split) = {
+   [RTSplitLinear] = LinearSplit,
+   [RTSplitQuadratic] = QuadraticSplit,
+   [RTSplitRStar] = RStarSplit,
+   [RTSplitGreene] = GreeneSplit
+};
 
 /*Wrapper for malloc checks for out of memory*/
 static void *mem_alloc(size_t size) {
@@ -59,6 +697,16 @@ static void *mem_alloc(size_t size) {
    return mem;
 }
 
+/*Wrapper for realloc checks for out of memory*/
+static void *mem_realloc(void *ptr, size_t size) {
+   void *mem = realloc(ptr, size);
+   if (!mem) {
+      fputs("fatal: out of memory.\n", stderr);
+      exit(EXIT_FAILURE);
+   }
+   return mem;
+}
+
 /*Returns false if the two shapes don't overlap and TRUE if they do*/
 static bool Overlap(RTdimension *S1, RTdimension *S2) {
    RTdimensionindex j = 0, k = 0;
@@ -100,24 +748,269 @@ static long double Volume(RTdimension *S) {
    long double volume = 1;
 
    for (j = 0, k = RTn; j < RTn; ++j, ++k)
-      /*1 added to each side to make lines and dots have volume*/
-      volume = safe_multiply(volume, (long double)S[k] - S[j] + 1);
+      /*GRAIN added to each side to make lines and dots of integer coordinates have volume*/
+      volume = safe_multiply(volume, (long double)S[k] - S[j] + GRAIN);
 
    return volume;
 }
 
+/*Returns the sum of the side lengths of a shape*/
+static long double Margin(RTdimension *S) {
+   RTdimensionindex j = 0, k = 0;
+   long double margin = 0;
+
+   for (j = 0, k = RTn; j < RTn; ++j, ++k)
+      margin += (long double)S[k] - S[j] + GRAIN;
+
+   return margin;
+}
+
+/*Returns volume shared by two shapes*/
+static long double Intersection(RTdimension *S1, RTdimension *S2) {
+   RTdimensionindex j = 0, k = 0;
+   RTdimension common[RTn*2];
+
+   for (j = 0, k = RTn; j < RTn; ++j, ++k) {
+      common[j] = S1[j] > S2[j] ? S1[j] : S2[j];
+      common[k] = S1[k] < S2[k] ? S1[k] : S2[k];
+      if (common[j] > common[k])
+         return 0;
+   }
+
+   return Volume(common);
+}
+
+/*Number of children of a node; children are always packed at the front*/
+static RTchildindex CountChildren(struct RTNode *N) {
+   RTchildindex low = 0, high = M, mid;
+
+   while (low < high) {
+      mid = low + (high - low) / 2;
+      if (IS_EMPTY(N->Child[mid]))
+         high = mid;
+      else
+         low = mid + 1;
+   }
+
+   return low;
+}
+
+/*Inserts an entry at a position, shifting the entries after it*/
+/*In: Node with room, Position, Entry*/
+static bool PlaceEntry(struct RTNode *N, RTchildindex pos, struct RTNode *E) {
+   RTchildindex count;
+
+   count = CountChildren(N);
+   memmove(N->Child+pos+1, N->Child+pos, (count - pos) * sizeof(N->Child[0]));
+   memcpy(N->Child+pos, E, sizeof(N->Child[pos]));
+
+   SyncNode(N);
+   return true;
+}
+
+/*Kamel, Faloutsos: Hilbert R-tree: An Improved R-tree Using Fractals*/
+/*Hilbert value of the center of a shape on a grid spanning the configured bounds*/
+static uint64_t HilbertKey(const struct RTree *R, RTdimension *S) {
+   uint64_t X[RTn], P, Q, t, key = 0;
+   long double center, span;
+   RTdimensionindex j, k;
+   int b;
+
+   for (j = 0, k = RTn; j < RTn; ++j, ++k) {
+      span = (long double)R->Config.Bounds[k] - R->Config.Bounds[j];
+      center = ((long double)S[j] + S[k]) / 2 - R->Config.Bounds[j];
+
+      if (center <= 0 || span <= 0)
+         X[j] = 0;
+      else if (center >= span)
+         X[j] = HILBERT_MAX;
+      else
+         X[j] = (uint64_t)(center / span * HILBERT_MAX);
+   }
+
+   /*Skilling: Programming the Hilbert curve; axes to transposed key*/
+   for (Q = (uint64_t)1 << (HILBERT_BITS - 1); Q > 1; Q >>= 1) {
+      P = Q - 1;
+      for (j = 0; j < RTn; ++j)
+         if (X[j] & Q)
+            X[0] ^= P;
+         else {
+            t = (X[0] ^ X[j]) & P;
+            X[0] ^= t;
+            X[j] ^= t;
+         }
+   }
+
+   for (j = 1; j < RTn; ++j)
+      X[j] ^= X[j-1];
+
+   for (t = 0, Q = (uint64_t)1 << (HILBERT_BITS - 1); Q > 1; Q >>= 1)
+      if (X[RTn-1] & Q)
+         t ^= Q - 1;
+
+   /*Interleave the transposed bits, most significant first*/
+   for (b = HILBERT_BITS - 1; b >= 0; --b)
+      for (j = 0; j < RTn; ++j)
+         key = (key << 1) | (((X[j] ^ t) >> b) & 1);
+
+   return key;
+}
+
+/*Largest Hilbert value in a subtree, or an entry's own*/
+/*Without RTREE_LHV it is found down the subtree's last entries, since nodes are kept in order*/
+static uint64_t HilbertLHV(const struct RTree *R, struct RTNode *N) {
+#ifdef RTREE_LHV
+   (void)R;
+   return N->LHV;
+#else
+   RTchildindex count;
+
+   while (N->Child) {
+      if ((count = CountChildren(N)) == 0)
+         return 0;
+      N = N->Child + count - 1;
+   }
+
+   return HilbertKey(R, N->I);
+#endif
+}
+
+/*Position of the first entry whose largest Hilbert value is at least h*/
+static RTchildindex HilbertSearch(const struct RTree *R, struct RTNode *N, uint64_t h) {
+   RTchildindex low = 0, high, mid;
+
+   high = CountChildren(N);
+   while (low < high) {
+      mid = low + (high - low) / 2;
+      if (HilbertLHV(R, N->Child+mid) < h)
+         low = mid + 1;
+      else
+         high = mid;
+   }
+
+   return low;
+}
+
+/*Algorithm ChooseLeaf for Hilbert ordered trees*/
+/*In: Path to Parent Node, Parent Level, Leaf Level, Hilbert Value  Out: Path to Chosen Leaf*/
+static bool HilbertChooseLeaf(const struct RTree *R, struct Path *path, size_t Start, size_t Stop, uint64_t h) {
+   struct RTNode *N = path->Node[path->Depth-1];
+   RTchildindex i;
+
+   /*C2 [Leaf check]*/
+   for ( ; Start != Stop; --Start) {
+      if (!IS_BRANCH(N) || path->Depth == MAX_HEIGHT) {
+         fputs("rtree on fire!\n", stderr);
+         return false;
+      }
+
+      /*C3 [Choose subtree] with the minimum LHV greater than h, or the last one*/
+      i = HilbertSearch(R, N, h);
+      if (i == CountChildren(N))
+         --i;
+
+      /*C4 [Descend until a leaf is reached]*/
+      N = N->Child+i;
+      path->Node[path->Depth++] = N;
+   }
+
+   return true;
+}
+
+/*Algorithm HandleOverflow*/
+/*Deferred 2-to-3 split: a full node shares its entries with a cooperating sibling and*/
+/*only splits into a new node once both are full*/
+/*In: Parent Node, Full Node, Extra Entry, Extra Hilbert Value  Out: Split Node*/
+static bool HilbertSplit(struct RTree *R, struct RTNode *P, struct RTNode *L, struct RTNode *E, uint64_t h, struct RTNode **split) {
+   struct RTNode NL[2*M+1], *S[3] = {L, NULL, NULL};
+   RTchildindex count, pos;
+   size_t n, s, t;
+
+   /*H1 [Pick the cooperating sibling]*/
+   if (P != NULL) {
+      pos = L - P->Child;
+      if ((size_t)pos + 1 < M && !IS_EMPTY(P->Child[pos+1]))
+         S[1] = L + 1;
+      else if (pos > 0) {
+         S[0] = L - 1;
+         S[1] = L;
+      }
+   }
+
+   /*The sibling is off the writer's path, so readers may still be searching it*/
+   if (S[0] != L)
+      Shadow(R, S[0]);
+   else if (S[1])
+      Shadow(R, S[1]);
+
+   /*H2 [Gather all entries in Hilbert order]*/
+   pos = HilbertSearch(R, L, h);
+   for (s = 0, t = 0; s < 2 && S[s]; ++s) {
+      if (S[s] == L)
+         pos += t;
+      count = CountChildren(S[s]);
+      memcpy(NL+t, S[s]->Child, count * sizeof(NL[0]));
+      t += count;
+   }
+   memmove(NL+pos+1, NL+pos, (t - pos) * sizeof(NL[0]));
+   memcpy(NL+pos, E, sizeof(NL[0]));
+   ++t;
+
+   /*H3 [Add a node once the siblings are full]*/
+   if (S[1] == NULL || t > 2 * R->Max) {
+      S[s] = (struct RTNode *)mem_alloc(sizeof(struct RTNode));
+      InitNodes(S[s], 1);
+      S[s]->Child = NewChildren(R);
+      ++s;
+      *split = S[s-1];
+   } else
+      *split = NULL;
+
+   /*H4 [Distribute evenly]*/
+   for (n = 0; n < s; ++n) {
+      FillNode(S[n], NL+STR_OFFSET(t, s, n), STR_OFFSET(t, s, n+1) - STR_OFFSET(t, s, n));
+      HomeEntries(R, S[n]->Child, 0, M);
+   }
+
+   return true;
+}
+
+/*Moves an updated leaf entry back into Hilbert order*/
+static bool HilbertReorder(const struct RTree *R, struct RTNode *L, RTchildindex pos) {
+   struct RTNode E;
+   RTchildindex count;
+
+   E = L->Child[pos];
+   count = CountChildren(L);
+   memmove(L->Child+pos, L->Child+pos+1, (count - 1 - pos) * sizeof(L->Child[0]));
+   InitNodes(L->Child+count-1, 1);
+
+   return PlaceEntry(L, HilbertSearch(R, L, HilbertLHV(R, &E)), &E);
+}
+
 /*Sets the Tuple of a Node*/
 /*In: Parent Node, Size, Tuple, New Tuple */
 bool RTUpdateTuple(RTreePtr *T, RTdimension I[], void *Tuple, void *New) {
    struct RTNode *L = NULL;
+   struct Path path;
    RTchildindex pos = 0;
 
-   FindLeaf(*T, I, Tuple, &L, &pos);
+   if ((*T)->Config.Sync == RTSyncLink)
+      return LinkUpdate(*T, I, Tuple, New, NULL);
 
-   if (!L)
+   HomeLeaf(*T, I, Tuple, &path, &pos);
+
+   if (pos == M)
       return false;
+   ShadowPath(*T, &path);
+   L = path.Node[path.Depth-1];
 
    ((L)->Child+pos)->Tuple = New;
+   if ((*T)->Config.Index) {
+      HomeDrop(&(*T)->Tuples, Tuple, L->Child);
+      HomeEntries(*T, L->Child, pos, pos+1);
+   }
+   Publish(*T);
    return true;
 }
 
@@ -125,223 +1018,3813 @@ bool RTUpdateTuple(RTreePtr *T, RTdimension I[], void *Tuple, void *New) {
 /*In: Parent Node, Size, Tuple, New Dimension */
 bool RTUpdateDimensions(RTreePtr *T, RTdimension I[], void *Tuple, RTdimension New[]) {
    struct RTNode *L = NULL;
+   struct Path path;
    RTchildindex pos = 0;
 
-   FindLeaf(*T, I, Tuple, &L, &pos);
+   if ((*T)->Config.Sync == RTSyncLink)
+      return LinkUpdate(*T, I, Tuple, Tuple, New);
 
-   if (!L)
+   HomeLeaf(*T, I, Tuple, &path, &pos);
+
+   if (pos == M)
       return false;
 
-   if (Within((RTdimension *)New, (L)->I))
+   if (Within((RTdimension *)New, path.Node[path.Depth-1]->I)) {
+      ShadowPath(*T, &path);
+      L = path.Node[path.Depth-1];
       memcpy(((L)->Child+pos)->I, New, sizeof(((L)->Child+pos)->I));
-   else {
-      Delete(T, I, Tuple);
-      Insert(T, LEVEL_LEAF, New, Tuple, NULL);
+      SyncNode(L);
+
+      /*Keep the leaf in Hilbert order, and the LHVs above it*/
+      if ((*T)->Config.Insert == RTInsertHilbert) {
+#ifdef RTREE_LHV
+         L->Child[pos].LHV = HilbertKey(*T, New);
+#endif
+         HilbertReorder(*T, L, pos);
+         while (--path.Depth > 0)
+            SyncNode(path.Node[path.Depth-1]);
+      }
+   } else {
+      Delete(*T, I, Tuple);
+      (*T)->Reinserted = 0;
+      Insert(*T, &(*T)->Root, LEVEL_LEAF, New, Tuple, NULL);
+   }
+
+   Publish(*T);
+   return true;
+}
+
+/*Gets the child array allocation counters of a tree*/
+/*In: Parent Node  Out: Counters*/
+bool RTSelectAllocStats(RTreePtr *T, struct RTAllocStats *stats) {
+   if (!T || !*T || !stats) {
+      fputs("RTree and stats cannot be NULL.\n", stderr);
+      return false;
    }
 
+   *stats = (*T)->Stats;
    return true;
 }
 
 /*Gets the Dimensions of an RTree*/
 /*In: Parent Node  Out: Size */
 bool RTSelectDimensions(RTreePtr *T, RTdimension I[]) {
-   memcpy(I, (*T)->I, sizeof((*T)->I));
+   struct RTNode root;
+   size_t slot;
+
+   if ((*T)->Config.Sync == RTSyncLink) {
+      LinkRoot(*T, &root);
+      memcpy(I, root.I, sizeof(root.I));
+      return true;
+   }
+
+   memcpy(I, ReadLock(*T, &slot)->I, sizeof((*T)->Root->I));
+   ReadUnlock(*T, slot);
    return true;
 }
 
 /*Creates a new Tree*/
 /*Out: Root Node  In: Nodes for bulk loading */
-bool RTNewTree(struct RTNode **T, struct RTNodeList *list) {
-   RTchildindex h;
-   size_t i, j, k;
+bool RTNewTree(RTreePtr *T, struct RTNodeList *list) {
+   return RTNewTreeConfig(T, list, NULL);
+}
+
+/*Creates a new Tree with the given settings*/
+/*Out: Root Node  In: Nodes for bulk loading, Settings */
+bool RTNewTreeConfig(RTreePtr *T, struct RTNodeList *list, const struct RTConfig *config) {
    struct RTNodeList *nodelist;
-   struct RTNode *node;
+   struct RTNode *E;
+   size_t n, i;
+
+   if (!T) {
+      fputs("RTree cannot be NULL.\n", stderr);
+      return false;
+   }
+
+   for (n = 0, nodelist = list; nodelist != NULL; ++n, nodelist = nodelist->Next) ;
+
+   E = (struct RTNode *)mem_alloc((n ? n : 1) * sizeof(struct RTNode));
+   for (i = 0, nodelist = list; nodelist != NULL; ++i, nodelist = nodelist->Next) {
+      /*An entry without Child or Tuple marks an empty slot*/
+      if (!nodelist->Tuple) {
+         fputs("Tuple cannot be NULL.\n", stderr);
+         free(E);
+         return false;
+      }
+      memcpy(E[i].I, nodelist->I, sizeof(E[i].I));
+      E[i].Tuple = nodelist->Tuple;
+   }
+
+   return LoadTree(T, E, NULL, n, config);
+}
+
+/*Creates a new Tree from an array of entries, copied and sorted on several threads*/
+/*Out: Root Node  In: Entries for bulk loading, Entry Count, Settings */
+bool RTNewTreeArray(RTreePtr *T, const struct RTEntry *entries, size_t count, const struct RTConfig *config) {
+   if (!T) {
+      fputs("RTree cannot be NULL.\n", stderr);
+      return false;
+   }
+
+   if (!entries && count) {
+      fputs("Entries cannot be NULL.\n", stderr);
+      return false;
+   }
+
+   /*Every entry is written by the loader threads*/
+   return LoadTree(T, (struct RTNode *)mem_realloc(NULL, (count ? count : 1) * sizeof(struct RTNode)), entries, count, config);
+}
+
+/*Checks the settings and bulk loads the entries into a new tree*/
+/*Out: Root Node  In: Entries (freed), Entries to copy or NULL, Entry Count, Settings */
+static bool LoadTree(RTreePtr *T, struct RTNode *E, const struct RTEntry *entries, size_t n, const struct RTConfig *config) {
+   static const RTdimension unset[RTn*2] = {0};
+   struct LoadEntries load;
+   struct RTree *R;
+   size_t t;
+   RTdimensionindex j, k;
+   bool loaded;
 
-   struct RTNode *stack, *stack_next, *branch, *branch_next;
+   if (!config)
+      config = &DEFAULT_CONFIG;
 
-   stack = NULL;
-   nodelist = list;
-   while (nodelist != NULL) {
-      node = (struct RTNode *)mem_alloc(sizeof(struct RTNode));
-      InitNodes(node, 1);
-      node->Child = (struct RTNode *)mem_alloc(M * sizeof(node->Child[0]));
-      InitNodes(node->Child, M);
+   if (config->Fill < 0 || config->Fill > 1) {
+      fputs("Fill must be between 0 and 1.\n", stderr);
+      free(E);
+      return false;
+   }
+
+   if (config->Insert == RTInsertHilbert && config->Load != RTLoadHilbert && n != 0) {
+      fputs("Hilbert insertion needs a Hilbert loaded tree.\n", stderr);
+      free(E);
+      return false;
+   }
+
+   /*Without bounds every key would be 0, and the tree would keep entries in insertion order*/
+   if (config->Insert == RTInsertHilbert && n == 0 && !memcmp(config->Bounds, unset, sizeof(unset))) {
+      fputs("Hilbert insertion into an empty tree needs Bounds.\n", stderr);
+      free(E);
+      return false;
+   }
 
-      memcpy(node->I, nodelist->I, sizeof(node->I));
-      for (i = 0; nodelist != NULL && i < M; ++i) {
-         memcpy(node->Child[i].I, nodelist->I, sizeof(node->Child[i].I));
-         node->Child[i].Tuple = nodelist->Tuple;
-         node->Child[i].Parent = node;
+   if (config->Split > RTSplitGreene || (config->Insert == RTInsertHilbert && config->Split != RTSplitDefault)) {
+      fputs("Split must be one of RTSplit; Hilbert insertion has its own.\n", stderr);
+      free(E);
+      return false;
+   }
+
+   if (config->Pool > RTPoolHuge) {
+      fputs("Pool must be one of RTPool.\n", stderr);
+      free(E);
+      return false;
+   }
+
+   if ((config->Fanout && (config->Fanout < 2 * m || config->Fanout > M))
+         || (config->MinFanout && (config->MinFanout < m || config->MinFanout > (config->Fanout ? config->Fanout : M) / 2))) {
+      fprintf(stderr, "Fanout must be between %d and %d, MinFanout between %d and half the Fanout.\n", 2 * m, (int)M, m);
+      free(E);
+      return false;
+   }
+
+#ifdef RTREE_ATOMIC
+   if (config->Sync > RTSyncLink) {
+#else
+   if (config->Sync != RTSyncNone) {
+#endif
+      fputs("Sync must be one of RTSync; RTSyncRCU and RTSyncLink need GCC or Clang.\n", stderr);
+      free(E);
+      return false;
+   }
+
+   if (config->Sync == RTSyncLink && (config->Insert != RTInsertGuttman || config->Pool != RTPoolNone)) {
+      fputs("RTSyncLink needs Guttman insertion and unpooled child arrays.\n", stderr);
+      free(E);
+      return false;
+   }
+
+   /*Every write of a shared tree copies its path, and so would move the homes of every entry on it*/
+   if (config->Index && config->Sync != RTSyncNone) {
+      fputs("Index needs RTSyncNone.\n", stderr);
+      free(E);
+      return false;
+   }
+
+   if (config->Load > RTLoadHilbert) {
+      fputs("Unknown load method.\n", stderr);
+      free(E);
+      return false;
+   }
+
+   R = (struct RTree *)mem_alloc(sizeof(struct RTree));
+   R->Config = *config;
+   if (R->Config.Fill == 0)
+      R->Config.Fill = 1.0;
+   if (R->Config.Split == RTSplitDefault)
+      R->Config.Split = R->Config.Insert == RTInsertRStar ? RTSplitRStar : RTSplitLinear;
+   R->Max = R->Config.Fanout ? R->Config.Fanout : M;
+   R->Min = R->Config.MinFanout ? R->Config.MinFanout : m;
+#ifdef LOAD_THREADS
+   if (R->Config.Threads == 0 && (long)(R->Config.Threads = (size_t)sysconf(_SC_NPROCESSORS_ONLN)) <= 0)
+      R->Config.Threads = 1;
+#else
+   R->Config.Threads = 1;
+#endif
+
+   /*Copy the entries and cover each chunk for the Hilbert curve bounds*/
+   load.From = entries;
+   load.E = E;
+   load.n = n;
+   load.Tasks = LoadChunks(R, n);
+   load.Cover = (RTdimension (*)[RTn*2])mem_alloc(load.Tasks * sizeof(load.Cover[0]));
+   if (!LoadRun(R, LoadEntriesTask, &load, load.Tasks, n)) {
+      fputs("Tuple cannot be NULL.\n", stderr);
+      free(load.Cover);
+      free(E);
+      free(R);
+      *T = NULL;
+      return false;
+   }
+
+   /*Without bounds the Hilbert curve covers the bulk loaded entries*/
+   if (!memcmp(R->Config.Bounds, unset, sizeof(unset)) && n != 0) {
+      memcpy(R->Config.Bounds, load.Cover[0], sizeof(R->Config.Bounds));
+      for (t = 1; t < load.Tasks; ++t)
+         for (j = 0, k = RTn; j < RTn; ++j, ++k) {
+            if (R->Config.Bounds[j] > load.Cover[t][j])
+               R->Config.Bounds[j] = load.Cover[t][j];
+            if (R->Config.Bounds[k] < load.Cover[t][k])
+               R->Config.Bounds[k] = load.Cover[t][k];
+         }
+   }
+   free(load.Cover);
+
+   loaded = PackLoad(R, &R->Root, E, n, (RTchildindex)(R->Config.Fill * R->Max));
+
+   if (!loaded) {
+      free(R);
+      *T = NULL;
+      return false;
+   }
+
+   if (R->Config.Index)
+      HomeTree(R, R->Root);
+
+   /*Readers get their own copy of the root; the writer's changes reach them through Publish*/
+   if (R->Config.Sync == RTSyncRCU) {
+      R->Readers = (struct ReaderSlot *)mem_alloc(RCU_READERS * sizeof(R->Readers[0]));
+      R->Epoch = 1;
+      R->Published = (struct RTNode *)mem_alloc(sizeof(struct RTNode));
+      *R->Published = *R->Root;
+   }
+
+   if (R->Config.Sync == RTSyncLink)
+      R->Height = NodeLevel(R->Root);
+
+   *T = R;
+   return true;
+}
+
+/*Copies entries into a newly allocated node and covers them*/
+/*Out: Node  In: Entries, Entry Count*/
+static bool PackNode(struct RTree *R, struct RTNode *node, struct RTNode *E, RTchildindex count) {
+   InitNodes(node, 1);
+   node->Child = NewChildren(R);
+
+   return FillNode(node, E, count);
+}
+
+/*Replaces the children of a node and covers them*/
+/*Out: Node  In: Entries, Entry Count*/
+static bool FillNode(struct RTNode *node, struct RTNode *E, RTchildindex count) {
+   RTchildindex i;
+   RTdimensionindex j, k;
+
+   InitNodes(node->Child, M);
+   memcpy(node->Child, E, count * sizeof(node->Child[0]));
+   memcpy(node->I, E[0].I, sizeof(node->I));
+
+   for (i = 0; i < count; ++i) {
+      for (j = 0, k = RTn; j < RTn; ++j, ++k) {
+         if (node->I[j] > E[i].I[j])
+            node->I[j] = E[i].I[j];
+         if (node->I[k] < E[i].I[k])
+            node->I[k] = E[i].I[k];
+      }
+   }
+
+   SyncNode(node);
+   return true;
+}
+
+/*Sorts entries by key, keeping both arrays in step*/
+static void SortNodes(struct RTNode *E, long double *key, size_t n) {
+   struct RTNode node;
+   long double pivot, swap;
+   size_t i, j;
+
+   while (n > 16) {
+      /*median of three*/
+      i = n / 2;
+      j = n - 1;
+      if (key[i] < key[0]) { swap = key[i]; key[i] = key[0]; key[0] = swap; node = E[i]; E[i] = E[0]; E[0] = node; }
+      if (key[j] < key[0]) { swap = key[j]; key[j] = key[0]; key[0] = swap; node = E[j]; E[j] = E[0]; E[0] = node; }
+      if (key[j] < key[i]) { swap = key[j]; key[j] = key[i]; key[i] = swap; node = E[j]; E[j] = E[i]; E[i] = node; }
+      pivot = key[i];
+
+      for (i = 0; ; ++i, --j) {
+         while (key[i] < pivot) ++i;
+         while (pivot < key[j]) --j;
+         if (i >= j)
+            break;
+         swap = key[i]; key[i] = key[j]; key[j] = swap;
+         node = E[i]; E[i] = E[j]; E[j] = node;
+      }
+
+      /*recurse into the smaller half*/
+      if (j + 1 < n - j - 1) {
+         SortNodes(E, key, j + 1);
+         E += j + 1;
+         key += j + 1;
+         n -= j + 1;
+      } else {
+         SortNodes(E + j + 1, key + j + 1, n - j - 1);
+         n = j + 1;
+      }
+   }
+
+   for (i = 1; i < n; ++i)
+      for (j = i; j > 0 && key[j] < key[j-1]; --j) {
+         swap = key[j]; key[j] = key[j-1]; key[j-1] = swap;
+         node = E[j]; E[j] = E[j-1]; E[j-1] = node;
+      }
+}
+
+/*Slabs a run of groups sorted by dimension j is sliced into, S = ceil(count^(1/(RTn-j)))*/
+static size_t STRSlabs(size_t count, RTdimensionindex j) {
+   size_t S, p;
+   RTdimensionindex r;
+
+   for (S = 1; ; ++S) {
+      for (r = j, p = 1; r < RTn && p < count; ++r)
+         p *= S;
+      if (p >= count)
+         return S;
+   }
+}
+
+/*Sort-Tile-Recursive: orders a run of groups by dimension j, then slices it into slabs*/
+/*In: Entries, Keys, Entry Count, Group Count, First Group, Groups In Run, Dimension  Out: Packed Nodes*/
+static bool STRTile(struct RTree *R, struct RTNode *E, long double *key, size_t n, size_t P, size_t g, size_t count, RTdimensionindex j, struct RTNode *out) {
+   size_t first, last, i, S, s;
+
+   first = STR_OFFSET(n, P, g);
+   last = STR_OFFSET(n, P, g + count);
+
+   for (i = first; i < last; ++i)
+      key[i] = (long double)E[i].I[j] + E[i].I[j+RTn];
+   SortNodes(E+first, key+first, last - first);
+
+   /*Pack the groups once every dimension has been sorted*/
+   if (j == RTn - 1) {
+      for (i = g; i < g + count; ++i)
+         if (!PackNode(R, out+i, E+STR_OFFSET(n, P, i), STR_OFFSET(n, P, i+1) - STR_OFFSET(n, P, i)))
+            return false;
+      return true;
+   }
+
+   for (S = STRSlabs(count, j); S > 0; --S) {
+      s = (count + S - 1) / S;
+      if (!STRTile(R, E, key, n, P, g, s, j+1, out))
+         return false;
+      g += s;
+      count -= s;
+   }
+
+   return true;
+}
+
+/*Bulk load by Sort-Tile-Recursive, Hilbert or list order packing*/
+/*Out: Root Node  In: Entries, Entry Count, Node Capacity*/
+static bool PackLoad(struct RTree *R, struct RTNode **T, struct RTNode *E, size_t n, RTchildindex b) {
+   struct LoadSlabs slabs;
+   struct RTNode *NE;
+   long double *key;
+   size_t P, S, i;
+   bool packed;
+
+   if (b < 2 * R->Min)
+      b = 2 * R->Min;
+   if (b > R->Max)
+      b = R->Max;
+
+   /*Every key is written before it is read*/
+   key = (long double *)mem_realloc(NULL, (n ? n : 1) * sizeof(key[0]));
+
+   /*Hilbert order is set once by the leaves; upper levels keep it*/
+   if (R->Config.Load == RTLoadHilbert) {
+      LoadKeysRun(R, E, key, n, RTn);
+      LoadSortRun(R, &E, &key, n);
+#ifdef RTREE_LHV
+      for (i = 0; i < n; ++i)
+         E[i].LHV = (uint64_t)key[i];
+#endif
+   }
+
+   /*Each pass packs one level into nodes of at most b entries*/
+   while (n > R->Max) {
+      P = (n + b - 1) / b;
+      NE = (struct RTNode *)mem_alloc(P * sizeof(struct RTNode));
+
+      /*Hilbert and list order are already set; only STR tiles each level*/
+      if (R->Config.Load != RTLoadSTR || RTn == 1) {
+         if (R->Config.Load == RTLoadSTR) {
+            LoadKeysRun(R, E, key, n, 0);
+            LoadSortRun(R, &E, &key, n);
+         }
+         packed = LoadPackRun(R, E, n, P, NE);
+      } else {
+         /*The first dimension is sorted by every thread at once, then each slab is tiled on its own*/
+         LoadKeysRun(R, E, key, n, 0);
+         LoadSortRun(R, &E, &key, n);
+
+         S = STRSlabs(P, 0);
+         slabs.R = R;
+         slabs.E = E;
+         slabs.key = key;
+         slabs.n = n;
+         slabs.P = P;
+         slabs.out = NE;
+         slabs.First = (size_t *)mem_alloc((S + 1) * sizeof(slabs.First[0]));
+         for (i = 0; i < S; ++i)
+            slabs.First[i+1] = slabs.First[i] + (P - slabs.First[i] + S - i - 1) / (S - i);
+
+         packed = LoadRun(R, LoadSlabTask, &slabs, S, n);
+         free(slabs.First);
+      }
+
+      if (!packed) {
+         free(NE);
+         free(key);
+         free(E);
+         *T = NULL;
+         return false;
+      }
+
+      free(E);
+      E = NE;
+      n = P;
+   }
+
+   /*Property (5) - Root and Leaf*/
+   *T = (struct RTNode *)mem_alloc(sizeof(struct RTNode));
+   if (n)
+      PackNode(R, *T, E, n);
+   else {
+      InitNodes(*T, 1);
+      (*T)->Child = NewChildren(R);
+   }
+
+   free(key);
+   free(E);
+   return true;
+}
+
+/*Parallel bulk loading: entries are copied, keyed and packed a chunk per task, sorted by a*/
+/*sample sort whose key ranges are each sorted by one task, and STR slabs are tiled a slab per*/
+/*task.  Each level packs into a fraction of its entries, so the upper levels soon drop back to*/
+/*one thread once they hold fewer than LOAD_GRAIN entries a thread.*/
+
+#define LOAD_SAMPLES 16 /*sampled keys per sample sort bucket*/
+
+/*Threads worth starting on n entries*/
+static size_t LoadThreads(const struct RTree *R, size_t n) {
+   size_t threads = (n + LOAD_GRAIN - 1) / LOAD_GRAIN;
+
+   if (threads > R->Config.Threads)
+      threads = R->Config.Threads;
+   return threads ? threads : 1;
+}
+
+/*Tasks n entries are split into; a few per thread so fast threads take work from slow ones*/
+static size_t LoadChunks(const struct RTree *R, size_t n) {
+   size_t threads = LoadThreads(R, n);
+
+   return threads == 1 ? 1 : threads * 4;
+}
+
+/*Takes tasks until none are left*/
+static void LoadWork(struct LoadJob *job) {
+   size_t task;
+
+#ifdef LOAD_THREADS
+   while ((task = __atomic_fetch_add(&job->Next, 1, __ATOMIC_RELAXED)) < job->Tasks)
+      if (!job->Run(job->Ctx, task))
+         __atomic_store_n(&job->Failed, true, __ATOMIC_RELAXED);
+#else
+   while ((task = job->Next++) < job->Tasks)
+      if (!job->Run(job->Ctx, task))
+         job->Failed = true;
+#endif
+}
+
+#ifdef LOAD_THREADS
+static void *LoadWorker(void *job) {
+   LoadWork((struct LoadJob *)job);
+   return NULL;
+}
+#endif
+
+/*Runs every task, on as many threads as the entries are worth, the caller's among them*/
+/*In: Tree, Task, Context, Task Count, Entries Covered  Out: false if a task failed*/
+static bool LoadRun(struct RTree *R, bool (*run)(void *ctx, size_t task), void *ctx, size_t tasks, size_t n) {
+   size_t threads = LoadThreads(R, n);
+   bool ok;
+
+   /*Child arrays are allocated on several threads at once*/
+   if (threads > 1 && tasks > 1)
+      R->Loading = true;
+   ok = TaskRun(run, ctx, tasks, threads);
+   R->Loading = false;
+   return ok;
+}
+
+/*Runs every task on up to the given number of threads, the caller's among them*/
+/*In: Task, Context, Task Count, Threads  Out: false if a task failed*/
+static bool TaskRun(bool (*run)(void *ctx, size_t task), void *ctx, size_t tasks, size_t threads) {
+   struct LoadJob job = {run, ctx, tasks, 0, false};
+#ifdef LOAD_THREADS
+   pthread_t *thread;
+   size_t started, i;
+
+   if (threads > tasks)
+      threads = tasks;
+
+   if (threads > 1) {
+      thread = (pthread_t *)mem_alloc((threads - 1) * sizeof(thread[0]));
+
+      /*A thread that fails to start leaves its share to the others*/
+      for (i = 0, started = 0; i < threads - 1; ++i)
+         if (pthread_create(&thread[started], NULL, LoadWorker, &job) == 0)
+            ++started;
+      LoadWork(&job);
+
+      for (i = 0; i < started; ++i)
+         pthread_join(thread[i], NULL);
+      free(thread);
+      return !job.Failed;
+   }
+#else
+   (void)threads;
+#endif
+
+   LoadWork(&job);
+   return !job.Failed;
+}
+
+/*Copies a chunk of entries and covers it*/
+static bool LoadEntriesTask(void *ctx, size_t task) {
+   struct LoadEntries *L = (struct LoadEntries *)ctx;
+   size_t first = STR_OFFSET(L->n, L->Tasks, task), last = STR_OFFSET(L->n, L->Tasks, task + 1), i;
+   RTdimension *cover = L->Cover[task];
+   RTdimensionindex j, k;
+
+   for (i = first; i < last; ++i) {
+      if (L->From) {
+         /*An entry without Child or Tuple marks an empty slot*/
+         if (!L->From[i].Tuple)
+            return false;
+         L->E[i].Child = NULL;
+         L->E[i].Tuple = L->From[i].Tuple;
+         memcpy(L->E[i].I, L->From[i].I, sizeof(L->E[i].I));
+      }
+
+      if (i == first)
+         memcpy(cover, L->E[i].I, sizeof(L->E[i].I));
+      else
+         for (j = 0, k = RTn; j < RTn; ++j, ++k) {
+            if (cover[j] > L->E[i].I[j])
+               cover[j] = L->E[i].I[j];
+            if (cover[k] < L->E[i].I[k])
+               cover[k] = L->E[i].I[k];
+         }
+   }
+
+   return true;
+}
+
+/*Keys a chunk of entries*/
+static bool LoadKeysTask(void *ctx, size_t task) {
+   struct LoadKeys *L = (struct LoadKeys *)ctx;
+   size_t first = STR_OFFSET(L->n, L->Tasks, task), last = STR_OFFSET(L->n, L->Tasks, task + 1), i;
+
+   if (L->Dim == RTn)
+      for (i = first; i < last; ++i)
+         L->key[i] = (long double)HilbertKey(L->R, L->E[i].I);
+   else
+      for (i = first; i < last; ++i)
+         L->key[i] = (long double)L->E[i].I[L->Dim] + L->E[i].I[L->Dim+RTn];
+
+   return true;
+}
+
+/*Finds the bucket of each entry of a chunk and counts the chunk's entries in each bucket*/
+static bool LoadCountTask(void *ctx, size_t task) {
+   struct LoadSort *S = (struct LoadSort *)ctx;
+   size_t first = STR_OFFSET(S->n, S->Chunks, task), last = STR_OFFSET(S->n, S->Chunks, task + 1), i, lo, hi, mid;
+   size_t *count = S->Offset + task * S->Buckets;
+
+   for (i = first; i < last; ++i) {
+      /*first splitter above the key*/
+      for (lo = 0, hi = S->Buckets - 1; lo < hi; )
+         if (S->key[i] < S->Split[mid = (lo + hi) / 2])
+            hi = mid;
+         else
+            lo = mid + 1;
+      S->Bucket[i] = (uint32_t)lo;
+      ++count[lo];
+   }
+
+   return true;
+}
+
+/*Moves the entries of a chunk to their buckets*/
+static bool LoadScatterTask(void *ctx, size_t task) {
+   struct LoadSort *S = (struct LoadSort *)ctx;
+   size_t first = STR_OFFSET(S->n, S->Chunks, task), last = STR_OFFSET(S->n, S->Chunks, task + 1), i, at;
+   size_t *offset = S->Offset + task * S->Buckets;
+
+   for (i = first; i < last; ++i) {
+      at = offset[S->Bucket[i]]++;
+      S->NE[at] = S->E[i];
+      S->nkey[at] = S->key[i];
+   }
+
+   return true;
+}
+
+/*Sorts the entries of a bucket*/
+static bool LoadBucketTask(void *ctx, size_t task) {
+   struct LoadSort *S = (struct LoadSort *)ctx;
+
+   SortNodes(S->NE + S->Start[task], S->nkey + S->Start[task], S->Start[task+1] - S->Start[task]);
+   return true;
+}
+
+/*Packs a run of groups into nodes*/
+static bool LoadPackTask(void *ctx, size_t task) {
+   struct LoadPack *L = (struct LoadPack *)ctx;
+   size_t g, last = STR_OFFSET(L->P, L->Tasks, task + 1);
+
+   for (g = STR_OFFSET(L->P, L->Tasks, task); g < last; ++g)
+      if (!PackNode(L->R, L->out+g, L->E+STR_OFFSET(L->n, L->P, g), STR_OFFSET(L->n, L->P, g+1) - STR_OFFSET(L->n, L->P, g)))
+         return false;
+
+   return true;
+}
+
+/*Tiles one STR slab over the remaining dimensions*/
+static bool LoadSlabTask(void *ctx, size_t task) {
+   struct LoadSlabs *L = (struct LoadSlabs *)ctx;
+
+   return STRTile(L->R, L->E, L->key, L->n, L->P, L->First[task], L->First[task+1] - L->First[task], 1, L->out);
+}
+
+/*Orders sample keys for qsort*/
+static int LoadCompare(const void *a, const void *b) {
+   long double x = *(const long double *)a, y = *(const long double *)b;
+
+   return x < y ? -1 : x > y;
+}
+
+/*Keys entries by dimension dim, or by Hilbert value when dim is RTn*/
+static void LoadKeysRun(struct RTree *R, struct RTNode *E, long double *key, size_t n, RTdimensionindex dim) {
+   struct LoadKeys L;
+
+   L.R = R;
+   L.E = E;
+   L.key = key;
+   L.n = n;
+   L.Tasks = LoadChunks(R, n);
+   L.Dim = dim;
+   LoadRun(R, LoadKeysTask, &L, L.Tasks, n);
+}
+
+/*Sorts entries by key, replacing both arrays when several threads share the sort*/
+/*In: Tree, Entries, Keys, Entry Count  Out: Sorted Entries, Sorted Keys*/
+static void LoadSortRun(struct RTree *R, struct RTNode **E, long double **key, size_t n) {
+   struct LoadSort S;
+   long double *sample;
+   size_t samples, i, b, c, at, count;
+
+   if (LoadThreads(R, n) == 1) {
+      SortNodes(*E, *key, n);
+      return;
+   }
+
+   S.E = *E;
+   S.key = *key;
+   S.n = n;
+   S.Chunks = LoadChunks(R, n);
+   S.Buckets = S.Chunks;
+
+   /*Splitters evenly spaced through a sorted sample of the keys*/
+   samples = S.Buckets * LOAD_SAMPLES;
+   sample = (long double *)mem_realloc(NULL, samples * sizeof(sample[0]));
+   for (i = 0; i < samples; ++i)
+      sample[i] = S.key[STR_OFFSET(n, samples, i)];
+   qsort(sample, samples, sizeof(sample[0]), LoadCompare);
+
+   S.Split = (long double *)mem_realloc(NULL, (S.Buckets - 1) * sizeof(S.Split[0]));
+   for (b = 0; b < S.Buckets - 1; ++b)
+      S.Split[b] = sample[(b + 1) * LOAD_SAMPLES];
+   free(sample);
+
+   S.Bucket = (uint32_t *)mem_realloc(NULL, n * sizeof(S.Bucket[0]));
+   S.Offset = (size_t *)mem_alloc(S.Chunks * S.Buckets * sizeof(S.Offset[0]));
+   S.Start = (size_t *)mem_alloc((S.Buckets + 1) * sizeof(S.Start[0]));
+   LoadRun(R, LoadCountTask, &S, S.Chunks, n);
+
+   /*Buckets follow each other, and each chunk's part of a bucket follows the chunks before it*/
+   for (b = 0, at = 0; b < S.Buckets; ++b) {
+      S.Start[b] = at;
+      for (c = 0; c < S.Chunks; ++c) {
+         count = S.Offset[c * S.Buckets + b];
+         S.Offset[c * S.Buckets + b] = at;
+         at += count;
+      }
+   }
+   S.Start[S.Buckets] = n;
+
+   S.NE = (struct RTNode *)mem_realloc(NULL, n * sizeof(S.NE[0]));
+   S.nkey = (long double *)mem_realloc(NULL, n * sizeof(S.nkey[0]));
+   LoadRun(R, LoadScatterTask, &S, S.Chunks, n);
+   LoadRun(R, LoadBucketTask, &S, S.Buckets, n);
+
+   free(S.Split);
+   free(S.Bucket);
+   free(S.Offset);
+   free(S.Start);
+   free(*E);
+   free(*key);
+   *E = S.NE;
+   *key = S.nkey;
+}
+
+/*Packs groups of entries into nodes, a run of groups per task*/
+/*In: Tree, Entries, Entry Count, Group Count  Out: Packed Nodes*/
+static bool LoadPackRun(struct RTree *R, struct RTNode *E, size_t n, size_t P, struct RTNode *out) {
+   struct LoadPack L;
+
+   L.R = R;
+   L.E = E;
+   L.n = n;
+   L.P = P;
+   L.out = out;
+   L.Tasks = LoadChunks(R, n);
+   if (L.Tasks > P)
+      L.Tasks = P;
+
+   return LoadRun(R, LoadPackTask, &L, L.Tasks, n);
+}
+
+/*Initializes an array of struct Nodes*/
+static bool InitNodes(struct RTNode *ptr, RTchildindex size) {
+   RTchildindex i;
+
+   for (i = 0; i < size; ++i) {
+      ptr[i] = EMPTY_NODE;
+   }
+
+   return true;
+}
+
+/*Allocates an empty child array*/
+static struct RTNode *NewChildren(struct RTree *R) {
+   bool link = R->Config.Sync == RTSyncLink;
+   struct RTNode *Child;
+   void *mem;
+#ifdef RTREE_ATOMIC
+   size_t blocks, peak;
+#endif
+
+   if (R->Config.Pool == RTPoolNone)
+      mem = mem_alloc(CHILD_BYTES + (link ? sizeof(struct Link) : 0));
+   else if (R->Loading) {
+      LatchLock(&R->PoolLatch);
+      mem = PoolAlloc(R);
+      LatchUnlock(&R->PoolLatch);
+   } else
+      mem = PoolAlloc(R);
+
+#ifdef RTREE_ATOMIC
+   /*Writers of RTSyncLink trees and loader threads allocate at once*/
+   if (link || R->Loading) {
+      __atomic_add_fetch(&R->Stats.Allocs, 1, __ATOMIC_RELAXED);
+      blocks = __atomic_add_fetch(&R->Stats.Blocks, 1, __ATOMIC_RELAXED);
+      peak = __atomic_load_n(&R->Stats.Peak, __ATOMIC_RELAXED);
+      while (peak < blocks && !__atomic_compare_exchange_n(&R->Stats.Peak, &peak, blocks, true, __ATOMIC_RELAXED, __ATOMIC_RELAXED)) ;
+   } else
+#endif
+   {
+      ++R->Stats.Allocs;
+      if (++R->Stats.Blocks > R->Stats.Peak)
+         R->Stats.Peak = R->Stats.Blocks;
+   }
+
+#ifdef RTREE_SOA
+   ((struct RTBlock *)mem)->Count = 0;
+   Child = ((struct RTBlock *)mem)->Child;
+#else
+   Child = (struct RTNode *)mem;
+#endif
+   InitNodes(Child, M);
+
+   /*Readers can't reach it before the next publish, so the writer may change it in place*/
+   if (R->Published) {
+      if (R->FreshCount == R->FreshCapacity) {
+         R->FreshCapacity = R->FreshCapacity ? R->FreshCapacity * 2 : MAX_HEIGHT;
+         R->Fresh = (struct RTNode **)mem_realloc(R->Fresh, R->FreshCapacity * sizeof(R->Fresh[0]));
+      }
+      R->Fresh[R->FreshCount++] = Child;
+   }
+
+   return Child;
+}
+
+/*Frees a child array*/
+static void FreeChildren(struct RTree *R, struct RTNode *Child) {
+   void *mem;
+
+   if (!Child)
+      return;
+#ifdef RTREE_SOA
+   mem = (char *)Child - offsetof(struct RTBlock, Child);
+#else
+   mem = Child;
+#endif
+
+   ++R->Stats.Frees;
+   --R->Stats.Blocks;
+
+   if (R->Config.Pool == RTPoolNone)
+      free(mem);
+   else {
+      *(void **)mem = R->Pool.Free;
+      R->Pool.Free = mem;
+   }
+}
+
+/*Hands out a page from the tree's pool, taking a new chunk when it runs dry*/
+static void *PoolAlloc(struct RTree *R) {
+   struct Pool *P = &R->Pool;
+   struct PoolChunk *C = NULL;
+   char *mem = NULL;
+   void *page = NULL;
+
+   if (P->Free) {
+      page = P->Free;
+      P->Free = *(void **)page;
+      return page;
+   }
+
+   if (P->Next == P->End) {
+      C = (struct PoolChunk *)mem_alloc(sizeof(struct PoolChunk));
+      C->Size = POOL_CHUNK;
+#ifdef POOL_MMAP
+#ifdef MAP_HUGETLB
+      /*Reserved huge pages first, when the system has any*/
+      if (R->Config.Pool == RTPoolHuge && (mem = mmap(NULL, C->Size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0)) != MAP_FAILED) {
+         C->Memory = mem;
+         ++R->Stats.Huge;
+      } else
+#endif
+      if (R->Config.Pool == RTPoolHuge) {
+         /*Map twice the size and trim to a chunk aligned range transparent huge pages can back*/
+         if ((mem = mmap(NULL, 2 * C->Size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0)) != MAP_FAILED) {
+            C->Memory = mem + (C->Size - (uintptr_t)mem % C->Size) % C->Size;
+            if ((char *)C->Memory > mem)
+               munmap(mem, (char *)C->Memory - mem);
+            munmap((char *)C->Memory + C->Size, mem + 2 * C->Size - ((char *)C->Memory + C->Size));
+#ifdef MADV_HUGEPAGE
+            madvise(C->Memory, C->Size, MADV_HUGEPAGE);
+            ++R->Stats.Huge;
+#endif
+         }
+      } else if ((mem = mmap(NULL, C->Size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0)) != MAP_FAILED)
+         C->Memory = mem;
+
+      if (!C->Memory) {
+         fputs("fatal: out of memory.\n", stderr);
+         exit(EXIT_FAILURE);
+      }
+      P->Next = (char *)C->Memory;
+#else
+      /*Without mmap the chunk is aligned by hand, giving up one page*/
+      C->Memory = mem = (char *)mem_alloc(C->Size);
+      P->Next = mem + (RTPS - (uintptr_t)mem % RTPS) % RTPS;
+#endif
+      P->End = (char *)C->Memory + C->Size;
+      P->End -= (P->End - P->Next) % RTPS;
+      C->Next = P->Chunks;
+      P->Chunks = C;
+      ++R->Stats.Chunks;
+      R->Stats.Reserved += C->Size;
+   }
+
+   page = P->Next;
+   P->Next += RTPS;
+   return page;
+}
+
+/*Returns every chunk of the tree's pool to the system*/
+static void PoolRelease(struct RTree *R) {
+   struct PoolChunk *C = NULL;
+
+   while ((C = R->Pool.Chunks) != NULL) {
+      R->Pool.Chunks = C->Next;
+#ifdef POOL_MMAP
+      munmap(C->Memory, C->Size);
+#else
+      free(C->Memory);
+#endif
+      free(C);
+   }
+
+   memset(&R->Pool, 0, sizeof(R->Pool));
+}
+
+/*Copies the children's boxes into the node's dense box arrays and adds up its entry count*/
+/*Called on a node after its children, so counts are right from the leaves up*/
+/*Every change to a node's children ends here, since searches read the dense copy and not the records*/
+static void SyncNode(struct RTNode *N) {
+#ifdef RTREE_SOA
+   struct RTBlock *B = BLOCK(N);
+   RTdimensionindex j;
+#endif
+#if defined(RTREE_SOA) || defined(RTREE_COUNT) || defined(RTREE_LHV)
+   RTchildindex i;
+#endif
+
+#ifdef RTREE_SOA
+   for (i = 0; i < M && !IS_EMPTY(N->Child[i]); ++i)
+      for (j = 0; j < RTn*2; ++j)
+         B->Box[j][i] = N->Child[i].I[j];
+   B->Count = i;
+#endif
+
+#ifdef RTREE_COUNT
+   for (N->Count = 0, i = 0; i < M && !IS_EMPTY(N->Child[i]); ++i)
+      N->Count += N->Child[i].Child ? N->Child[i].Count : 1;
+#endif
+
+#ifdef RTREE_LHV
+   /*Hilbert ordered children end with the largest value*/
+   for (i = 0; i < M && !IS_EMPTY(N->Child[i]); ++i) ;
+   N->LHV = i ? N->Child[i-1].LHV : 0;
+#endif
+
+#if !defined(RTREE_SOA) && !defined(RTREE_COUNT) && !defined(RTREE_LHV)
+   (void)N;
+#endif
+}
+
+/*Read-copy-update for RTSyncRCU trees*/
+/*Readers start from the published copy of the root, and no child array they can reach ever changes:*/
+/*the writer copies each array before changing it and publishes a new root once an operation is done.*/
+/*Replaced memory waits until the epoch has moved on twice, which a reader inside the tree holds back*/
+/*(Fraser: Practical Lock-Freedom, epoch based reclamation)*/
+
+/*Enters the tree for reading*/
+/*In: Tree  Out: Reader Slot for ReadUnlock, Root to search from*/
+static struct RTNode *ReadLock(struct RTree *R, size_t *slot) {
+#ifdef RTREE_ATOMIC
+   uint64_t epoch, free;
+   size_t i;
+
+   if (R->Config.Sync == RTSyncRCU) {
+      /*Threads start at different slots, hashed from their stacks*/
+      i = (size_t)(((uint64_t)(uintptr_t)slot >> 4) * 0x9E3779B97F4A7C15u >> 40) % RCU_READERS;
+      for ( ; ; i = (i + 1) % RCU_READERS) {
+         epoch = __atomic_load_n(&R->Epoch, __ATOMIC_SEQ_CST);
+         free = 0;
+         if (__atomic_compare_exchange_n(&R->Readers[i].Epoch, &free, epoch, false, __ATOMIC_SEQ_CST, __ATOMIC_RELAXED))
+            break;
+      }
+
+      /*Loaded after the slot is taken, so nothing it reaches is freed before ReadUnlock*/
+      *slot = i;
+      return __atomic_load_n(&R->Published, __ATOMIC_SEQ_CST);
+   }
+#endif
+
+   *slot = RCU_READERS;
+   return R->Root;
+}
+
+/*Leaves the tree*/
+/*In: Tree, Reader Slot from ReadLock*/
+static void ReadUnlock(struct RTree *R, size_t slot) {
+#ifdef RTREE_ATOMIC
+   if (slot < RCU_READERS)
+      __atomic_store_n(&R->Readers[slot].Epoch, 0, __ATOMIC_RELEASE);
+#else
+   (void)R;
+   (void)slot;
+#endif
+}
+
+/*Returns true if readers can't reach the child array*/
+static bool IsFresh(const struct RTree *R, struct RTNode *Child) {
+   size_t i;
+
+   for (i = 0; i < R->FreshCount; ++i)
+      if (R->Fresh[i] == Child)
+         return true;
+
+   return false;
+}
+
+/*Gives a node its own copy of a child array readers may be searching, before the writer changes it*/
+static void Shadow(struct RTree *R, struct RTNode *N) {
+   struct RTNode *old = N->Child;
+
+   if (!R->Published || !old || IsFresh(R, old))
+      return;
+
+   N->Child = NewChildren(R);
+#ifdef RTREE_SOA
+   memcpy(BLOCK(N), (char *)old - offsetof(struct RTBlock, Child), CHILD_BYTES);
+#else
+   memcpy(N->Child, old, CHILD_BYTES);
+#endif
+   Retire(R, old, true);
+}
+
+/*Shadows every child array from the root down the path, moving the path onto the copies*/
+static void ShadowPath(struct RTree *R, struct Path *path) {
+   struct RTNode *old;
+   size_t d;
+
+   for (d = 0; d < path->Depth; ++d) {
+      old = path->Node[d]->Child;
+      Shadow(R, path->Node[d]);
+      if (d + 1 < path->Depth)
+         path->Node[d+1] = path->Node[d]->Child + (path->Node[d+1] - old);
+   }
+}
+
+/*Frees a child array the writer took out of the tree, or retires it while readers may hold it*/
+static void DropChildren(struct RTree *R, struct RTNode *Child) {
+   size_t i;
+
+   if (R->Config.Index)
+      HomeDrop(&R->Arrays, Child, NULL);
+
+   for (i = 0; i < R->FreshCount && R->Fresh[i] != Child; ++i) ;
+
+   if (R->Published && i == R->FreshCount) {
+      Retire(R, Child, true);
+      return;
+   }
+
+   if (i < R->FreshCount)
+      R->Fresh[i] = R->Fresh[--R->FreshCount];
+   FreeChildren(R, Child);
+}
+
+/*Queues replaced memory until readers are done with it*/
+/*In: Tree, Child Array or Published Root, Whether it is a Child Array*/
+static void Retire(struct RTree *R, struct RTNode *N, bool array) {
+   struct Retired *D = (struct Retired *)mem_alloc(sizeof(struct Retired));
+
+   D->Node = N;
+   D->Array = array;
+   D->Epoch = R->Epoch;
+   D->Next = R->Retired;
+   R->Retired = D;
+}
+
+/*Frees the memory retired before an epoch*/
+static void Reclaim(struct RTree *R, uint64_t epoch) {
+   struct Retired **D = &R->Retired, *dead;
+
+   /*Newest first, so everything past the first one found is older*/
+   while (*D && (*D)->Epoch >= epoch)
+      D = &(*D)->Next;
+
+   while ((dead = *D) != NULL) {
+      *D = dead->Next;
+      if (dead->Array)
+         FreeChildren(R, dead->Node);
+      else
+         free(dead->Node);
+      free(dead);
+   }
+}
+
+/*Shows readers the writer's changes and frees what none of them can still reach*/
+static void Publish(struct RTree *R) {
+#ifdef RTREE_ATOMIC
+   struct RTNode *root;
+   uint64_t epoch, e;
+   size_t i;
+
+   if (!R->Published || !R->Root)
+      return;
+
+   root = (struct RTNode *)mem_alloc(sizeof(struct RTNode));
+   *root = *R->Root;
+   Retire(R, __atomic_exchange_n(&R->Published, root, __ATOMIC_SEQ_CST), false);
+   R->FreshCount = 0;
+
+   /*The epoch moves on once every reader inside entered in it*/
+   epoch = R->Epoch;
+   for (i = 0; i < RCU_READERS; ++i)
+      if ((e = __atomic_load_n(&R->Readers[i].Epoch, __ATOMIC_SEQ_CST)) != 0 && e != epoch)
+         break;
+   if (i == RCU_READERS)
+      __atomic_store_n(&R->Epoch, ++epoch, __ATOMIC_SEQ_CST);
+
+   /*Readers inside entered in the last epoch at the earliest, after anything retired before it was unpublished*/
+   Reclaim(R, epoch - 1);
+#else
+   (void)R;
+#endif
+}
+
+/*R-link trees for RTSyncLink (Kornacker, Banks: High-Concurrency Locking in R-Trees)*/
+/*Each child array carries a version latch, the node sequence number (NSN) of its last split and a link*/
+/*to the node that split took off it.  A split stamps the node with a new NSN from the tree's sequence*/
+/*while the parent is latched, so a traversal that read the parent before the split sees an NSN larger*/
+/*than the sequence number it read there and follows the link to the entries that moved.  Readers take*/
+/*no latch: they copy what they need from a node and read again if its version changed meanwhile.*/
+/*Child arrays are only freed with the tree, so a reader can never touch freed memory.*/
+
+#ifdef RTREE_ATOMIC
+/*Spins, then gives the processor away to a writer holding the latch*/
+static void Backoff(unsigned spins) {
+#ifdef LATCH_YIELD
+   if (spins >= 64) {
+      sched_yield();
+      return;
+   }
+#endif
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+   __builtin_ia32_pause();
+#else
+   (void)spins;
+#endif
+}
+
+/*Waits until no writer holds the latch*/
+/*In: Latch  Out: Version to check reads against*/
+static uint64_t LatchRead(uint64_t *latch) {
+   uint64_t version;
+   unsigned spins;
+
+   for (spins = 0; (version = __atomic_load_n(latch, __ATOMIC_ACQUIRE)) & 1; ++spins)
+      Backoff(spins);
+
+   return version;
+}
+
+/*Returns true if no writer took the latch since LatchRead*/
+static bool LatchCheck(uint64_t *latch, uint64_t version) {
+   __atomic_thread_fence(__ATOMIC_ACQUIRE);
+   return __atomic_load_n(latch, __ATOMIC_RELAXED) == version;
+}
+
+/*Takes a latch for writing*/
+static void LatchLock(uint64_t *latch) {
+   uint64_t version;
+
+   do
+      version = LatchRead(latch);
+   while (!__atomic_compare_exchange_n(latch, &version, version + 1, false, __ATOMIC_ACQUIRE, __ATOMIC_RELAXED));
+
+   /*Readers must see the odd version before any change made under it*/
+   __atomic_thread_fence(__ATOMIC_RELEASE);
+}
+
+/*Releases a latch, publishing the changes made under it*/
+static void LatchUnlock(uint64_t *latch) {
+   __atomic_store_n(latch, __atomic_load_n(latch, __ATOMIC_RELAXED) + 1, __ATOMIC_RELEASE);
+}
+
+/*Current tree sequence number*/
+static uint64_t LinkSequence(struct RTree *R) {
+   return __atomic_load_n(&R->Sequence, __ATOMIC_ACQUIRE);
+}
+#else
+static uint64_t LatchRead(uint64_t *latch) {
+   return *latch;
+}
+
+static bool LatchCheck(uint64_t *latch, uint64_t version) {
+   return *latch == version;
+}
+
+static void LatchLock(uint64_t *latch) {
+   ++*latch;
+}
+
+static void LatchUnlock(uint64_t *latch) {
+   ++*latch;
+}
+
+static uint64_t LinkSequence(struct RTree *R) {
+   return R->Sequence;
+}
+#endif
+
+/*Copies the root entry*/
+/*In: Tree  Out: Root Entry, Sequence Number to read its children at*/
+static uint64_t LinkRoot(struct RTree *R, struct RTNode *root) {
+   uint64_t version, expect;
+
+   do {
+      version = LatchRead(&R->Latch);
+      *root = *R->Root;
+      expect = LinkSequence(R);
+   } while (!LatchCheck(&R->Latch, version));
+
+   return expect;
+}
+
+/*Copies the children of a node a traversal picks, reading again until no writer changed the node meanwhile*/
+/*In: Tree, Child Array, Sequence Number its Parent was read at, Search Box, Pick or NULL for all  Out: Copy*/
+static void LinkRead(struct RTree *R, struct RTNode *Child, uint64_t expect, RTdimension S[], void (*pick)(struct RTNode *T, RTdimension S[], uint64_t mask[]), struct LinkNode *out) {
+   struct RTNode N = EMPTY_NODE;
+   struct Link *L = LINK(Child);
+   uint64_t mask[MASK_WORDS];
+   RTchildindex i;
+
+   N.Child = Child;
+   out->From = Child;
+   do {
+      out->Version = LatchRead(&L->Version);
+      if (pick)
+         pick(&N, S, mask);
+      else
+         ChildMask(&N, mask);
+      for (out->Count = 0; (i = NextChild(mask)) < M; )
+         out->Child[out->Count++] = Child[i];
+      out->Right = L->NSN > expect ? L->Right : NULL;
+      out->Expect = LinkSequence(R);
+   } while (!LatchCheck(&L->Version, out->Version));
+}
+
+/*Queues a child array for an R-link traversal*/
+static void LinkPush(struct LinkPath *path, struct RTNode *Child, uint64_t expect) {
+   if (path->Count == path->Capacity) {
+      path->Capacity = path->Capacity ? path->Capacity * 2 : MAX_HEIGHT;
+      path->Wait = (struct LinkWait *)mem_realloc(path->Wait, path->Capacity * sizeof(path->Wait[0]));
+   }
+
+   path->Wait[path->Count].Child = Child;
+   path->Wait[path->Count].Expect = expect;
+   path->Count++;
+}
+
+/*Starts an R-link traversal at the root*/
+static void LinkOpen(struct RTree *R, struct LinkPath *path) {
+   struct RTNode root;
+   uint64_t expect = LinkRoot(R, &root);
+
+   path->Wait = NULL;
+   path->Count = path->Capacity = 0;
+   path->Node.Count = path->Next = 0;
+   LinkPush(path, root.Child, expect);
+}
+
+/*Walks an R-link traversal until it is exhausted or the visitor stops*/
+/*In: Tree, Traversal, Search Box, Pick, Visitor, Visitor Context*/
+static bool LinkResume(struct RTree *R, struct LinkPath *path, RTdimension S[], void (*pick)(struct RTNode *T, RTdimension S[], uint64_t mask[]), RTVisitor visit, void *ctx) {
+   struct LinkWait W;
+   struct RTNode *E;
+   RTchildindex i;
+
+   for ( ; ; ) {
+      /*S2 [Search leaf node]*/
+      while (path->Next < path->Node.Count) {
+         E = path->Node.Child + path->Next++;
+         if (!visit(E->I, E->Tuple, ctx))
+            return true;
+      }
+
+      if (!path->Count)
+         return true;
+      W = path->Wait[--path->Count];
+      LinkRead(R, W.Child, W.Expect, S, pick, &path->Node);
+      path->Next = 0;
+
+      /*Entries split off since the parent was read*/
+      if (path->Node.Right)
+         LinkPush(path, path->Node.Right, W.Expect);
+
+      /*S1 [Search subtrees]*/
+      if (path->Node.Count && path->Node.Child[0].Child) {
+         for (i = path->Node.Count; i-- > 0; )
+            LinkPush(path, path->Node.Child[i].Child, path->Node.Expect);
+         path->Node.Count = 0;
+      }
+   }
+}
+
+/*In: Tree, Search Box, Visitor, Visitor Context*/
+static bool LinkSearch(struct RTree *R, RTdimension S[], RTVisitor visit, void *ctx) {
+   struct LinkPath path;
+   bool ok;
+
+   LinkOpen(R, &path);
+   ok = LinkResume(R, &path, S, OverlapMask, visit, ctx);
+   free(path.Wait);
+   return ok;
+}
+
+/*Stops at the entry LinkLocate looks for*/
+static bool LinkFindVisitor(RTdimension I[], void *Tuple, void *ctx) {
+   struct LinkFind *find = (struct LinkFind *)ctx;
+
+   find->found = Tuple == find->Tuple && !memcmp(I, find->I, RTn*2 * sizeof(I[0]));
+   return !find->found;
+}
+
+/*Algorithm FindLeaf for R-link trees*/
+/*In: Tree, Size, Tuple  Out: Latched Leaf, Position; false if the tree has no such entry*/
+static bool LinkLocate(struct RTree *R, RTdimension I[], void *Tuple, struct RTNode **leaf, RTchildindex *position) {
+   struct LinkPath path;
+   struct LinkFind find;
+   struct RTNode *L;
+   RTchildindex i;
+
+   find.I = I;
+   find.Tuple = Tuple;
+
+   /*The entry may move between the copy it was found in and the latch*/
+   for ( ; ; ) {
+      find.found = false;
+      LinkOpen(R, &path);
+      LinkResume(R, &path, I, ContainMask, LinkFindVisitor, &find);
+      free(path.Wait);
+      if (!find.found)
+         return false;
+
+      L = path.Node.From;
+      LatchLock(&LINK(L)->Version);
+      for (i = 0; i < M && !IS_EMPTY(L[i]); ++i)
+         if (L[i].Tuple == Tuple && !memcmp(L[i].I, I, sizeof(L[i].I))) {
+            *leaf = L;
+            *position = i;
+            return true;
+         }
+      LatchUnlock(&LINK(L)->Version);
+   }
+}
+
+/*Links the node split off a node into its chain and gives the node a new sequence number*/
+/*In: Tree, Node that Split, Node Split Off*/
+static void LinkSplit(struct RTree *R, struct RTNode *L, struct RTNode *LL) {
+   struct Link *old = LINK(L->Child), *split = LINK(LL->Child);
+
+   split->NSN = old->NSN;
+   split->Right = old->Right;
+   old->Right = LL->Child;
+#ifdef RTREE_ATOMIC
+   old->NSN = __atomic_add_fetch(&R->Sequence, 1, __ATOMIC_RELEASE);
+#else
+   old->NSN = ++R->Sequence;
+#endif
+}
+
+/*Releases the latches an R-link writer holds*/
+/*In: Tree, Latched Child Arrays, Count, Whether the Root Latch is held*/
+static void LinkRelease(struct RTree *R, struct RTNode *held[], size_t n, bool rooted) {
+   while (n)
+      LatchUnlock(&LINK(held[--n])->Version);
+   if (rooted)
+      LatchUnlock(&R->Latch);
+}
+
+/*Algorithm Insert for R-link trees*/
+/*Writers latch top down and left to right, so they never deadlock.  When every box on the way already*/
+/*covers the entry, only the leaf is latched.  Otherwise the writer couples latches down from the root,*/
+/*letting go of everything above a node with room, which no split can pass*/
+/*In: Tree, Size, Tuple*/
+static bool LinkInsert(struct RTree *R, RTdimension I[], void *Tuple) {
+   struct RTNode *held[MAX_HEIGHT], *A, *C, *F, *L, *LL = NULL, *splitR = NULL, N, top, root[2];
+   struct Path path;
+   uint64_t *latch, version, v;
+   size_t h, n = 0;
+   RTchildindex i;
+   RTdimensionindex j, k;
+   bool covered, rooted, ok = true;
+
+   /*Optimistic pass; a child picked from a node stays right as long as the node's version holds*/
+   for ( ; ; ) {
+      latch = &R->Latch;
+      version = LatchRead(latch);
+      A = R->Root->Child;
+      h = R->Height;
+      covered = Within(I, R->Root->I);
+      if (!LatchCheck(latch, version))
+         continue;
+      if (!covered)
+         break;
+
+      /*CL3 [Choose subtree]*/
+      for ( ; h > 1; --h) {
+         N = EMPTY_NODE;
+         N.Child = A;
+         v = LatchRead(&LINK(A)->Version);
+         F = ChooseSubtree(R, &N, I, false);
+         C = F->Child;
+         covered = Within(I, F->I);
+         if (!LatchCheck(&LINK(A)->Version, v) || !covered)
+            break;
+         latch = &LINK(A)->Version;
+         version = v;
+         A = C;
+      }
+      if (h > 1 && !covered)
+         break;
+      if (h > 1)
+         continue;
+
+      /*I2 [Add record to leaf node]*/
+      LatchLock(&LINK(A)->Version);
+      if (!LatchCheck(latch, version)) {
+         LatchUnlock(&LINK(A)->Version);
+         continue;
+      }
+      for (i = 0; i < R->Max && !IS_EMPTY(A[i]); ++i) ;
+      if (i < R->Max) {
+         A[i] = EMPTY_NODE;
+         memcpy(A[i].I, I, sizeof(A[i].I));
+         A[i].Tuple = Tuple;
+         N = EMPTY_NODE;
+         N.Child = A;
+         SyncNode(&N);
+      }
+      LatchUnlock(&LINK(A)->Version);
+      if (i < R->Max)
+         return true;
+      break;
+   }
+
+   /*Pessimistic pass; boxes grow top down, each while its parent is latched*/
+   LatchLock(&R->Latch);
+   rooted = true;
+   h = R->Height;
+   path.Depth = 0;
+   F = R->Root;
+   for ( ; ; ) {
+      LatchLock(&LINK(F->Child)->Version);
+      if (IS_EMPTY(F->Child[0]))
+         memcpy(F->I, I, sizeof(F->I));
+      else for (j = 0, k = RTn; j < RTn; ++j, ++k) {
+         if (F->I[j] > I[j])
+            F->I[j] = I[j];
+         if (F->I[k] < I[k])
+            F->I[k] = I[k];
+      }
+      if (path.Depth)
+         SyncNode(path.Node[path.Depth-1]);
+
+      /*A node with room takes a split below without splitting, so nothing above it changes*/
+      if (IS_EMPTY(F->Child[R->Max-1])) {
+         top = *F;
+         LinkRelease(R, held, n, rooted);
+         n = 0;
+         rooted = false;
+         path.Depth = 0;
+         F = &top;
+      }
+      held[n++] = F->Child;
+      path.Node[path.Depth++] = F;
+      if (--h == 0)
+         break;
+
+      /*CL3 [Choose subtree]*/
+      F = ChooseSubtree(R, F, I, false);
+   }
+
+   /*I2 [Add record to leaf node]*/
+   L = path.Node[path.Depth-1];
+   for (i = 0; i < R->Max && !IS_EMPTY(L->Child[i]); ++i) ;
+   if (i < R->Max) {
+      memcpy(L->Child[i].I, I, sizeof(L->Child[i].I));
+      L->Child[i].Tuple = Tuple;
+      SyncNode(L);
+   } else
+      ok = OverflowTreatment(R, PARENT(&path, path.Depth-1), L, I, Tuple, NULL, &LL);
+
+   /*I3 [Propagate changes upward]*/
+   if (ok)
+      ok = AdjustTree(R, &path, LL, &splitR);
+
+   /*I4 [Grow tree taller]*/
+   /*Only a full root splits, and then its latch is still held*/
+   if (ok && splitR) {
+      root[0] = *R->Root;
+      root[1] = *splitR;
+      free(splitR);
+
+      R->Root->Child = NewChildren(R);
+      FillNode(R->Root, root, 2);
+      ++R->Height;
+   }
+
+   LinkRelease(R, held, n, rooted);
+   return ok;
+}
+
+/*Algorithm Delete for R-link trees*/
+/*The leaf gives up the entry in place; nodes are never condensed, so boxes may stay larger than needed*/
+/*In: Tree, Dead Size, Dead Tuple*/
+static bool LinkDelete(struct RTree *R, RTdimension I[], void *Tuple) {
+   struct RTNode *L, N = EMPTY_NODE;
+   RTchildindex pos;
+
+   /*D1 [Find node containing record]*/
+   if (!LinkLocate(R, I, Tuple, &L, &pos))
+      return false;
+
+   /*D2 [Delete record]*/
+   memmove(L+pos, L+pos+1, (M - 1 - pos) * sizeof(L[pos]));
+   InitNodes(L+M-1, 1);
+   N.Child = L;
+   SyncNode(&N);
+   LatchUnlock(&LINK(L)->Version);
+   return true;
+}
+
+/*Changes an entry in place under its leaf's latch; a box outgrowing the old one moves the entry*/
+/*In: Tree, Size, Tuple, New Tuple, New Size or NULL*/
+static bool LinkUpdate(struct RTree *R, RTdimension I[], void *Tuple, void *New, RTdimension Size[]) {
+   struct RTNode *L, N = EMPTY_NODE;
+   RTchildindex pos;
+
+   if (!LinkLocate(R, I, Tuple, &L, &pos))
+      return false;
+
+   if (!Size || Within(Size, L[pos].I)) {
+      L[pos].Tuple = New;
+      if (Size) {
+         memcpy(L[pos].I, Size, sizeof(L[pos].I));
+         N.Child = L;
+         SyncNode(&N);
+      }
+      LatchUnlock(&LINK(L)->Version);
+      return true;
+   }
+   LatchUnlock(&LINK(L)->Version);
+
+   /*Searches in between may miss the entry*/
+   return LinkDelete(R, I, Tuple) && LinkInsert(R, Size, Tuple);
+}
+
+#ifndef RTREE_SOA
+/*Sets a bit for each child overlapping the search box*/
+static void OverlapMask(struct RTNode *T, RTdimension S[], uint64_t mask[]) {
+   RTchildindex i;
+
+   memset(mask, 0, MASK_WORDS * sizeof(mask[0]));
+   for (i = 0; i < M && !IS_EMPTY(T->Child[i]); ++i)
+      if (Overlap(T->Child[i].I, S))
+         mask[i / 64] |= (uint64_t)1 << (i % 64);
+}
+
+/*Sets a bit for each child containing the shape*/
+static void ContainMask(struct RTNode *T, RTdimension I[], uint64_t mask[]) {
+   RTchildindex i;
+
+   memset(mask, 0, MASK_WORDS * sizeof(mask[0]));
+   for (i = 0; i < M && !IS_EMPTY(T->Child[i]); ++i)
+      if (Within(I, T->Child[i].I))
+         mask[i / 64] |= (uint64_t)1 << (i % 64);
+}
+#else
+/*Sets a bit for each child whose box satisfies Box[j] <= X[j] && Y[j] <= Box[j+RTn] in every dimension*/
+/*Whole node scan over the dense boxes, without branching per dimension*/
+static void RangeMaskScalar(struct RTBlock *B, RTdimension X[], RTdimension Y[], uint64_t mask[]) {
+   RTchildindex i;
+   RTdimensionindex j;
+   uint64_t hit;
+
+   memset(mask, 0, MASK_WORDS * sizeof(mask[0]));
+   for (i = 0; i < B->Count; ++i) {
+      hit = 1;
+      for (j = 0; j < RTn; ++j)
+         hit &= (uint64_t)(B->Box[j][i] <= X[j]) & (uint64_t)(Y[j] <= B->Box[j+RTn][i]);
+      mask[i / 64] |= hit << (i % 64);
+   }
+}
+
+#ifdef RTREE_SIMD
+/*Tests as many children at once as fit in a vector of the given width*/
+#define RANGE_KERNEL(name, isa, width) \
+__attribute__((target(isa))) \
+static void name(struct RTBlock *B, RTdimension X[], RTdimension Y[], uint64_t mask[]) { \
+   typedef RTdimension vector __attribute__((vector_size(width))); \
+   enum { LANES = width / sizeof(RTdimension) }; \
+   RTchildindex i, l, count = B->Count; \
+   RTdimensionindex j; \
+   vector lo, hi, x, y; \
+   __typeof__(lo < hi) hit; \
+   uint64_t bit; \
+ \
+   memset(mask, 0, MASK_WORDS * sizeof(mask[0])); \
+   for (i = 0; i + LANES <= count; i += LANES) { \
+      for (j = 0; j < RTn; ++j) { \
+         memcpy(&lo, &B->Box[j][i], sizeof(lo)); \
+         memcpy(&hi, &B->Box[j+RTn][i], sizeof(hi)); \
+         x = (vector){0} + X[j]; \
+         y = (vector){0} + Y[j]; \
+         if (j == 0) \
+            hit = (lo <= x) & (y <= hi); \
+         else \
+            hit &= (lo <= x) & (y <= hi); \
+      } \
+      for (l = 0; l < LANES; ++l) { \
+         bit = (uint64_t)(hit[l] != 0); \
+         mask[(i + l) / 64] |= bit << ((i + l) % 64); \
+      } \
+   } \
+ \
+   for ( ; i < count; ++i) { \
+      bit = 1; \
+      for (j = 0; j < RTn; ++j) \
+         bit &= (uint64_t)(B->Box[j][i] <= X[j]) & (uint64_t)(Y[j] <= B->Box[j+RTn][i]); \
+      mask[i / 64] |= bit << (i % 64); \
+   } \
+}
+
+RANGE_KERNEL(RangeMaskSSE4, "sse4.2", 16)
+RANGE_KERNEL(RangeMaskAVX2, "avx2", 32)
+RANGE_KERNEL(RangeMaskAVX512, "avx512f", 64)
+
+/*Picks the widest kernel the CPU supports on first use*/
+static void RangeMaskResolve(struct RTBlock *B, RTdimension X[], RTdimension Y[], uint64_t mask[]) {
+   void (*kernel)(struct RTBlock *B, RTdimension X[], RTdimension Y[], uint64_t mask[]);
+
+   __builtin_cpu_init();
+   if (__builtin_cpu_supports("avx512f"))
+      kernel = RangeMaskAVX512;
+   else if (__builtin_cpu_supports("avx2"))
+      kernel = RangeMaskAVX2;
+   else if (__builtin_cpu_supports("sse4.2"))
+      kernel = RangeMaskSSE4;
+   else
+      kernel = RangeMaskScalar;
+
+   __atomic_store_n(&RangeMaskKernel, kernel, __ATOMIC_RELAXED);
+   kernel(B, X, Y, mask);
+}
+#endif
+
+/*Sets a bit for each child overlapping the search box*/
+static void OverlapMask(struct RTNode *T, RTdimension S[], uint64_t mask[]) {
+   RANGE_MASK(BLOCK(T), S+RTn, S, mask);
+}
+
+/*Sets a bit for each child containing the shape*/
+static void ContainMask(struct RTNode *T, RTdimension I[], uint64_t mask[]) {
+   RANGE_MASK(BLOCK(T), I, I+RTn, mask);
+}
+#endif
+
+/*Sets a bit for each child*/
+static void ChildMask(struct RTNode *T, uint64_t mask[]) {
+   RTchildindex n = CountChildren(T), w;
+
+   for (w = 0; w < MASK_WORDS; ++w, n = n > 64 ? n - 64 : 0)
+      mask[w] = n >= 64 ? ~(uint64_t)0 : ((uint64_t)1 << n) - 1;
+}
+
+/*Sets a bit for each child to search, and returns whether the node lies within the search box*/
+/*A node within it, or below one that is, has every child set without testing them*/
+static bool SearchMask(struct RTNode *T, RTdimension S[], bool within, uint64_t mask[]) {
+   if (within || Within(T->I, S)) {
+      ChildMask(T, mask);
+      return true;
+   }
+
+   OverlapMask(T, S, mask);
+   return false;
+}
+
+/*Clears and returns the lowest set bit, or M once none are left*/
+static RTchildindex NextChild(uint64_t mask[]) {
+   RTchildindex w, b;
+
+   for (w = 0; w < MASK_WORDS; ++w)
+      if (mask[w]) {
+#ifdef __GNUC__
+         b = (RTchildindex)__builtin_ctzll(mask[w]);
+#else
+         for (b = 0; !((mask[w] >> b) & 1); ++b) ;
+#endif
+         mask[w] &= mask[w] - 1;
+         return w * 64 + b;
+      }
+
+   return M;
+}
+
+/*Frees the children of a Tree*/
+static bool FreeNodes(struct RTree *R, struct RTNode *T) {
+   struct SearchPath path;
+   struct RTNode *N;
+   RTchildindex i;
+
+   path.Depth = 1;
+   path.Stack[0].Node = T;
+   ChildMask(T, path.Stack[0].Mask);
+
+   /*Children are freed before the node holding them*/
+   while (path.Depth) {
+      N = path.Stack[path.Depth-1].Node;
+      i = IS_BRANCH(N) ? NextChild(path.Stack[path.Depth-1].Mask) : M;
+
+      if (i < M) {
+         if (path.Depth == MAX_HEIGHT) {
+            fputs("rtree on fire!\n", stderr);
+            return false;
+         }
+         path.Stack[path.Depth].Node = N->Child+i;
+         ChildMask(N->Child+i, path.Stack[path.Depth].Mask);
+         ++path.Depth;
+      } else {
+         FreeChildren(R, N->Child);
+         --path.Depth;
+      }
+   }
+
+   return true;
+}
+
+/*Frees a Tree*/
+bool RTFreeTree(RTreePtr *T) {
+   if (!T || !*T)
+      return true;
+
+   if ((*T)->Root) {
+      /*Pooled child arrays go back with their chunks*/
+      if ((*T)->Config.Pool == RTPoolNone && !FreeNodes(*T, (*T)->Root))
+         return false;
+
+      free((*T)->Root);
+   }
+
+   /*Callers make sure no reader is left*/
+   Reclaim(*T, (uint64_t)-1);
+   free((*T)->Published);
+   free((*T)->Readers);
+   free((*T)->Fresh);
+   free((*T)->Tuples.Slot);
+   free((*T)->Arrays.Slot);
+   PoolRelease(*T);
+   free(*T);
+   *T = NULL;
+   return true;
+}
+
+/*3.1 Searching*/
+/*Algorithm Search*/
+/*In: Parent Node, Search Box  Out: Hit List, Hit Count*/
+bool RTSelectTuple(RTreePtr *T, RTdimension S[], struct RTNodeList **list, size_t *count) {
+   struct SelectList hits;
+   bool ok;
+
+   if (!T || !*T || !(*T)->Root) {
+      fputs("RTree cannot be NULL.\n", stderr);
+      return false;
+   }
+
+   if (!list && !count) {
+      fputs("Must have List and/or Count.\n", stderr);
+      return false;
+   }
+
+   if (!list)
+      return RTSelectCount(T, S, count);
+
+   hits.list = list;
+   hits.count = 0;
+
+   ok = SearchTree(*T, S, SelectListVisitor, &hits, NULL);
+   if (!ok) {
+      if (list) *list = NULL;
+      if (count) *count = 0;
+      return false;
+   }
+
+   if (count) *count = hits.count;
+   return true;
+}
+
+/*Counts the hits; under RTREE_COUNT subtrees within the search box are counted without reading them*/
+/*In: Parent Node, Search Box  Out: Hit Count*/
+bool RTSelectCount(RTreePtr *T, RTdimension S[], size_t *count) {
+   struct SelectList hits;
+   size_t slot;
+   bool ok;
+
+   if (!T || !*T || !(*T)->Root) {
+      fputs("RTree cannot be NULL.\n", stderr);
+      return false;
+   }
+
+   if (!S || !count) {
+      fputs("Must have Search Box and Count.\n", stderr);
+      return false;
+   }
+
+   /*R-link writers don't carry counts up to the root*/
+   if ((*T)->Config.Sync == RTSyncLink) {
+      hits.list = NULL;
+      hits.count = 0;
+      ok = LinkSearch(*T, S, SelectListVisitor, &hits);
+      *count = ok ? hits.count : 0;
+      return ok;
+   }
+
+   ok = CountSearch(ReadLock(*T, &slot), S, count);
+   ReadUnlock(*T, slot);
+   return ok;
+}
+
+/*Calls the visitor for every hit until it returns false*/
+/*In: Parent Node, Search Box, Visitor, Visitor Context*/
+bool RTSelectVisit(RTreePtr *T, RTdimension S[], RTVisitor visit, void *ctx) {
+   if (!T || !*T || !(*T)->Root) {
+      fputs("RTree cannot be NULL.\n", stderr);
+      return false;
+   }
+
+   if (!visit) {
+      fputs("Must have Visitor.\n", stderr);
+      return false;
+   }
+
+   return SearchTree(*T, S, visit, ctx, NULL);
+}
+
+/*Fills a caller owned buffer with the hits, reusing its memory between queries*/
+/*In: Parent Node, Search Box  Out: Hit Buffer, Hit Count*/
+bool RTSelectResults(RTreePtr *T, RTdimension S[], struct RTResults *results, size_t *count) {
+   struct CursorFetch fetch;
+   bool ok;
+
+   if (!T || !*T || !(*T)->Root) {
+      fputs("RTree cannot be NULL.\n", stderr);
+      return false;
+   }
+
+   if (!results) {
+      fputs("Must have Results.\n", stderr);
+      return false;
+   }
+
+   results->Count = 0;
+   if (count) *count = 0;
+
+   fetch.results = results;
+   fetch.limit = SIZE_MAX;
+   ok = SearchTree(*T, S, CursorFetchVisitor, &fetch, &fetch);
+   if (!ok) {
+      results->Count = 0;
+      return false;
+   }
+
+   if (count) *count = results->Count;
+   return true;
+}
+
+/*Runs many searches at once, on several threads, searching nearby boxes together*/
+/*Hits of query q go to visit with ctx[q], or without a visitor fill results[q]*/
+/*In: Parent Node, Search Boxes, Query Count, Visitor, Visitor Contexts  Out: Hit Buffers*/
+bool RTSelectBatch(RTreePtr *T, RTdimension S[][RTn*2], size_t count, RTVisitor visit, void *ctx[], struct RTResults results[]) {
+   struct RTree keyer;
+   struct Batch B;
+   long double *key;
+   size_t q, groups;
+   RTdimensionindex j, k;
+   bool ok;
+
+   if (!T || !*T || !(*T)->Root) {
+      fputs("RTree cannot be NULL.\n", stderr);
+      return false;
+   }
+
+   if ((!S && count) || !visit == !results) {
+      fputs("Must have Search Boxes and one of Visitor and Results.\n", stderr);
+      return false;
+   }
+
+   if (count == 0)
+      return true;
+
+   if (results)
+      for (q = 0; q < count; ++q)
+         results[q].Count = 0;
+
+   /*Queries are grouped in Hilbert order of their centers, on a curve spanning every query*/
+   memset(&keyer, 0, sizeof(keyer));
+   keyer.Config.Threads = (*T)->Config.Threads;
+   memcpy(keyer.Config.Bounds, S[0], sizeof(keyer.Config.Bounds));
+   B.E = (struct RTNode *)mem_alloc(count * sizeof(B.E[0]));
+   for (q = 0; q < count; ++q) {
+      for (j = 0, k = RTn; j < RTn; ++j, ++k) {
+         if (keyer.Config.Bounds[j] > S[q][j])
+            keyer.Config.Bounds[j] = S[q][j];
+         if (keyer.Config.Bounds[k] < S[q][k])
+            keyer.Config.Bounds[k] = S[q][k];
+      }
+      memcpy(B.E[q].I, S[q], sizeof(B.E[q].I));
+      B.E[q].Tuple = S[q];
+   }
+
+   key = (long double *)mem_realloc(NULL, count * sizeof(key[0]));
+   LoadKeysRun(&keyer, B.E, key, count, RTn);
+   LoadSortRun(&keyer, &B.E, &key, count);
+   free(key);
+
+   B.R = *T;
+   B.S = S;
+   B.visit = visit;
+   B.ctx = ctx;
+   B.results = visit ? NULL : results;
+   B.n = count;
+
+   groups = (count + BATCH_GROUP - 1) / BATCH_GROUP;
+   ok = TaskRun(BatchTask, &B, groups, (*T)->Config.Threads);
+   free(B.E);
+
+   if (!ok && results)
+      for (q = 0; q < count; ++q)
+         results[q].Count = 0;
+   return ok;
+}
+
+/*Calls the visitor for every pair of overlapping entries, one from each tree, until it returns false*/
+/*Both trees are walked together, and only pairs of subtrees whose covers overlap are read*/
+/*In: First Tree, Second Tree, Visitor, Visitor Context*/
+bool RTJoin(RTreePtr *A, RTreePtr *B, RTJoinVisitor visit, void *ctx) {
+   if (!A || !*A || !(*A)->Root || !B || !*B || !(*B)->Root) {
+      fputs("RTree cannot be NULL.\n", stderr);
+      return false;
+   }
+
+   if (!visit) {
+      fputs("Must have Visitor.\n", stderr);
+      return false;
+   }
+
+   return JoinTrees(*A, *B, visit, ctx, 1);
+}
+
+/*RTJoin on the first tree's Threads threads; the visitor may be called from several at once*/
+/*In: First Tree, Second Tree, Visitor, Visitor Context*/
+bool RTJoinParallel(RTreePtr *A, RTreePtr *B, RTJoinVisitor visit, void *ctx) {
+   if (!A || !*A || !(*A)->Root || !B || !*B || !(*B)->Root) {
+      fputs("RTree cannot be NULL.\n", stderr);
+      return false;
+   }
+
+   if (!visit) {
+      fputs("Must have Visitor.\n", stderr);
+      return false;
+   }
+
+   return JoinTrees(*A, *B, visit, ctx, (*A)->Config.Threads);
+}
+
+/*Frees the memory held by a result buffer*/
+bool RTFreeResults(struct RTResults *results) {
+   if (!results)
+      return true;
+
+   free(results->Result);
+   results->Result = NULL;
+   results->Count = 0;
+   results->Capacity = 0;
+   return true;
+}
+
+/*Appends each hit to the result buffer, doubling it when full*/
+static bool SelectResultsVisitor(RTdimension I[], void *Tuple, void *ctx) {
+   struct RTResults *results = (struct RTResults *)ctx;
+
+   if (results->Count == results->Capacity) {
+      results->Capacity = results->Capacity ? results->Capacity * 2 : RTPS / sizeof(results->Result[0]);
+      results->Result = (struct RTResult *)mem_realloc(results->Result, results->Capacity * sizeof(results->Result[0]));
+   }
+
+   memcpy(results->Result[results->Count].I, I, sizeof(results->Result[0].I));
+   results->Result[results->Count].Tuple = Tuple;
+   results->Result[results->Count].Distance = 0;
+   results->Count++;
+
+   return true;
+}
+
+/*Prepends each hit to a list and counts it*/
+static bool SelectListVisitor(RTdimension I[], void *Tuple, void *ctx) {
+   struct SelectList *hits = (struct SelectList *)ctx;
+   struct RTNodeList *curr = NULL;
+
+   if (hits->list) {
+      curr = (struct RTNodeList *)mem_alloc(sizeof(struct RTNodeList));
+      memcpy(curr->I, I, sizeof(curr->I));
+      curr->Tuple = Tuple;
+      curr->Next = *hits->list;
+      *hits->list = curr;
+   }
+   hits->count++;
+
+   return true;
+}
+
+/*Searches from the root readers may use under the tree's Sync setting*/
+/*In: Tree, Search Box, Visitor, Visitor Context, Buffer taking whole leaves or NULL*/
+static bool SearchTree(struct RTree *R, RTdimension S[], RTVisitor visit, void *ctx, struct CursorFetch *fetch) {
+   size_t slot;
+   bool ok;
+
+   if (R->Config.Sync == RTSyncLink)
+      return LinkSearch(R, S, visit, ctx);
+
+   ok = Search(ReadLock(R, &slot), S, visit, ctx, fetch);
+   ReadUnlock(R, slot);
+   return ok;
+}
+
+/*In: Parent Node, Search Box, Visitor, Visitor Context, Buffer taking whole leaves or NULL*/
+static bool Search(struct RTNode *T, RTdimension S[], RTVisitor visit, void *ctx, struct CursorFetch *fetch) {
+   struct SearchPath path;
+
+   if (!Overlap(T->I, S))
+      return true;
+
+   path.Depth = 1;
+   path.Stack[0].Node = T;
+   path.Stack[0].Within = SearchMask(T, S, false, path.Stack[0].Mask);
+
+   return Resume(&path, S, visit, ctx, fetch);
+}
+
+/*Algorithm Search, counting the hits*/
+/*In: Parent Node, Search Box  Out: Hit Count*/
+static bool CountSearch(struct RTNode *T, RTdimension S[], size_t *count) {
+   struct SearchPath path;
+   struct RTNode *N;
+   RTchildindex i;
+
+   *count = 0;
+   if (!Overlap(T->I, S))
+      return true;
+
+   path.Depth = 1;
+   path.Stack[0].Node = T;
+   path.Stack[0].Within = SearchMask(T, S, false, path.Stack[0].Mask);
+
+   while (path.Depth) {
+      N = path.Stack[path.Depth-1].Node;
+
+      /*Every entry of a leaf within the search box is a hit*/
+      if (path.Stack[path.Depth-1].Within && IS_LEAF(N)) {
+         *count += CountChildren(N);
+         --path.Depth;
+         continue;
+      }
+
+      /*S2 [Search leaf node]*/
+      while ((i = NextChild(path.Stack[path.Depth-1].Mask)) < M && !N->Child[i].Child)
+         ++*count;
+
+      /*S1 [Search subtrees]*/
+      if (i < M) {
+#ifdef RTREE_COUNT
+         /*Every entry of a subtree within the search box is a hit*/
+         if (path.Stack[path.Depth-1].Within || Within(N->Child[i].I, S)) {
+            *count += N->Child[i].Count;
+            continue;
+         }
+#endif
+         if (path.Depth == MAX_HEIGHT) {
+            fputs("rtree on fire!\n", stderr);
+            *count = 0;
+            return false;
+         }
+         path.Stack[path.Depth].Node = N->Child+i;
+         path.Stack[path.Depth].Within = SearchMask(N->Child+i, S, path.Stack[path.Depth-1].Within, path.Stack[path.Depth].Mask);
+         ++path.Depth;
+      } else
+         --path.Depth;
+   }
+
+   return true;
+}
+
+/*Walks the tree from the saved path until it is exhausted or the visitor stops*/
+/*In: Traversal Path, Search Box, Visitor, Visitor Context, Buffer taking whole leaves or NULL*/
+static bool Resume(struct SearchPath *path, RTdimension S[], RTVisitor visit, void *ctx, struct CursorFetch *fetch) {
+   struct RTNode *T;
+   RTchildindex i, n;
+
+   while (path->Depth) {
+      T = path->Stack[path->Depth-1].Node;
+
+      /*Every entry left in a leaf within the search box is a hit, and they run on to its last child*/
+      if (path->Stack[path->Depth-1].Within && IS_LEAF(T)) {
+         if ((i = NextChild(path->Stack[path->Depth-1].Mask)) < M) {
+            n = CountChildren(T);
+            if (fetch) {
+               /*A leaf only partly taken keeps the rest for the next fetch*/
+               if (n - i >= fetch->limit - fetch->results->Count) {
+                  n = (RTchildindex)(i + (fetch->limit - fetch->results->Count));
+                  TakeEntries(fetch, T->Child+i, n - i);
+                  for (++i; i < n; ++i)
+                     NextChild(path->Stack[path->Depth-1].Mask);
+                  return true;
+               }
+               TakeEntries(fetch, T->Child+i, n - i);
+            } else
+               for ( ; i < n; ++i)
+                  if (!visit(T->Child[i].I, T->Child[i].Tuple, ctx))
+                     return true;
+         }
+         --path->Depth;
+         continue;
+      }
+
+      /*S2 [Search leaf node]*/
+      /*Property (5) - Root and Leaf*/
+      while ((i = NextChild(path->Stack[path->Depth-1].Mask)) < M && !T->Child[i].Child)
+         if (!visit(T->Child[i].I, T->Child[i].Tuple, ctx))
+            return true;
+
+      /*S1 [Search subtrees]*/
+      if (i < M) {
+         if (path->Depth == MAX_HEIGHT) {
+            fputs("rtree on fire!\n", stderr);
+            path->Depth = 0;
+            return false;
+         }
+         path->Stack[path->Depth].Node = T->Child+i;
+         path->Stack[path->Depth].Within = SearchMask(T->Child+i, S, path->Stack[path->Depth-1].Within, path->Stack[path->Depth].Mask);
+         ++path->Depth;
+      } else
+         --path->Depth;
+   }
+
+   return true;
+}
+
+/*Searches one group of a batch*/
+static bool BatchTask(void *ctx, size_t task) {
+   struct Batch *B = (struct Batch *)ctx;
+   size_t Q[BATCH_GROUP], first = task * BATCH_GROUP, count, i, slot;
+   bool ok = true;
+
+   count = B->n - first < BATCH_GROUP ? B->n - first : BATCH_GROUP;
+   for (i = 0; i < count; ++i)
+      Q[i] = (size_t)((RTdimension (*)[RTn*2])B->E[first+i].Tuple - B->S);
+
+   /*R-link trees move entries between reads; each query follows the links on its own*/
+   if (B->R->Config.Sync == RTSyncLink) {
+      for (i = 0; i < count; ++i)
+         if (B->results)
+            ok = LinkSearch(B->R, B->S[Q[i]], SelectResultsVisitor, B->results + Q[i]) && ok;
+         else
+            ok = LinkSearch(B->R, B->S[Q[i]], B->visit, B->ctx ? B->ctx[Q[i]] : NULL) && ok;
+      return ok;
+   }
+
+   BatchSearch(B, ReadLock(B->R, &slot), Q, count);
+   ReadUnlock(B->R, slot);
+   return true;
+}
+
+/*Searches for a group of queries at once, reading each node one time for every query overlapping it*/
+/*In: Batch, Parent Node, Queries of the group, Query Count*/
+static void BatchSearch(struct Batch *B, struct RTNode *T, const size_t Q[], size_t count) {
+   struct BatchEntry *stack = NULL;
+   size_t depth = 0, capacity = 0;
+   uint64_t live, queries, hits[M], mask[MASK_WORDS];
+   RTchildindex i, used = 0;
+   unsigned b;
+
+   /*Queries whose visitor stopped leave live*/
+   live = count == 64 ? ~(uint64_t)0 : ((uint64_t)1 << count) - 1;
+   for (queries = 0, b = 0; b < count; ++b)
+      if (Overlap(T->I, B->S[Q[b]]))
+         queries |= (uint64_t)1 << b;
+
+   /*hits[i] holds the queries overlapping child i; it is cleared again as it is used*/
+   memset(hits, 0, sizeof(hits));
+
+   while (queries) {
+      while ((b = NextBit(&queries)) < 64) {
+         SearchMask(T, B->S[Q[b]], false, mask);
+         while ((i = NextChild(mask)) < M) {
+            hits[i] |= (uint64_t)1 << b;
+            if (i >= used)
+               used = i + 1;
+         }
+      }
+
+      /*S2 [Search leaf node]*/
+      if (IS_LEAF(T)) {
+         for (i = 0; i < used; ++i) {
+            for (queries = hits[i] & live; (b = NextBit(&queries)) < 64; )
+               if (!BatchVisit(B, Q[b], T->Child[i].I, T->Child[i].Tuple))
+                  live &= ~((uint64_t)1 << b);
+            hits[i] = 0;
+         }
+      /*S1 [Search subtrees], first child on top*/
+      } else
+         for (i = used; i-- > 0; ) {
+            if (hits[i]) {
+               if (depth == capacity) {
+                  capacity = capacity ? capacity * 2 : M;
+                  stack = (struct BatchEntry *)mem_realloc(stack, capacity * sizeof(stack[0]));
+               }
+               stack[depth].Node = T->Child + i;
+               stack[depth].Queries = hits[i];
+               ++depth;
+            }
+            hits[i] = 0;
+         }
+      used = 0;
+
+      for (queries = 0; !queries && depth; ) {
+         --depth;
+         T = stack[depth].Node;
+         queries = stack[depth].Queries & live;
+      }
+   }
+
+   free(stack);
+}
+
+/*Hands a hit to query q*/
+static bool BatchVisit(struct Batch *B, size_t q, RTdimension I[], void *Tuple) {
+   if (B->results)
+      return SelectResultsVisitor(I, Tuple, B->results + q);
+   return B->visit(I, Tuple, B->ctx ? B->ctx[q] : NULL);
+}
+
+/*Clears and returns the lowest set bit of a word, or 64 once none are left*/
+static unsigned NextBit(uint64_t *word) {
+   unsigned b;
+
+   if (!*word)
+      return 64;
+#ifdef __GNUC__
+   b = (unsigned)__builtin_ctzll(*word);
+#else
+   for (b = 0; !((*word >> b) & 1); ++b) ;
+#endif
+   *word &= *word - 1;
+   return b;
+}
+
+/*Synchronized traversal spatial join (Brinkhoff, Kriegel, Seeger: Efficient Processing of Spatial Joins Using R-trees)*/
+/*In: First Tree, Second Tree, Visitor, Visitor Context, Threads*/
+static bool JoinTrees(struct RTree *A, struct RTree *B, RTJoinVisitor visit, void *ctx, size_t threads) {
+   struct JoinProbe probe;
+   struct JoinPair *next;
+   struct RTNode *rootA, *rootB;
+   RTdimension cover[RTn*2];
+   RTreePtr T = A;
+   size_t slotA, slotB, i, n, capacity;
+   bool grown = true, ok;
+   struct Join J = {visit, ctx, NULL, 0, false};
+
+   /*R-link trees move entries between reads; each entry of the first tree probes the second*/
+   if (A->Config.Sync == RTSyncLink || B->Config.Sync == RTSyncLink) {
+      probe.J = &J;
+      probe.B = B;
+      RTSelectDimensions(&T, cover);
+      return SearchTree(A, cover, JoinOuterVisitor, &probe, NULL);
+   }
+
+   rootA = ReadLock(A, &slotA);
+   rootB = ReadLock(B, &slotB);
+
+   capacity = 0;
+   if (Overlap(rootA->I, rootB->I))
+      JoinPush(rootA, rootB, NodeLevel(rootA), NodeLevel(rootB), &J.Pair, &J.n, &capacity);
+
+   /*Pairs are split a level at a time until every thread has several to take*/
+   while (threads > 1 && grown && J.n && J.n < threads * JOIN_TASKS) {
+      next = NULL;
+      n = 0;
+      capacity = 0;
+      grown = false;
+      for (i = 0; i < J.n; ++i)
+         if (J.Pair[i].LevelA > LEVEL_LEAF || J.Pair[i].LevelB > LEVEL_LEAF) {
+            JoinExpand(&J, J.Pair + i, &next, &n, &capacity);
+            grown = true;
+         } else
+            JoinPush(J.Pair[i].A, J.Pair[i].B, J.Pair[i].LevelA, J.Pair[i].LevelB, &next, &n, &capacity);
+      free(J.Pair);
+      J.Pair = next;
+      J.n = n;
+   }
+
+   ok = TaskRun(JoinTask, &J, J.n, threads);
+
+   ReadUnlock(B, slotB);
+   ReadUnlock(A, slotA);
+   free(J.Pair);
+   return ok;
+}
+
+/*Joins one pair of subtrees, depth first*/
+static bool JoinTask(void *ctx, size_t task) {
+   struct Join *J = (struct Join *)ctx;
+   struct JoinPair *stack, P;
+   size_t depth = 1, capacity = M;
+
+   stack = (struct JoinPair *)mem_realloc(NULL, capacity * sizeof(stack[0]));
+   stack[0] = J->Pair[task];
+
+   while (depth && !JoinStopped(J)) {
+      P = stack[--depth];
+      if (!JoinExpand(J, &P, &stack, &depth, &capacity))
+         break;
+   }
+
+   free(stack);
+   return true;
+}
+
+/*Joins a pair of subtrees one level down: overlapping entries go to the visitor and overlapping subtrees on the list*/
+/*In: Join, Pair  Out: Pair List, List Length, List Capacity; false once the visitor stops*/
+static bool JoinExpand(struct Join *J, const struct JoinPair *P, struct JoinPair **list, size_t *n, size_t *capacity) {
+   struct RTNode *a[M], *b[M];
+   RTdimension X[RTn*2];
+   uint64_t mask[MASK_WORDS];
+   RTchildindex na = 0, nb = 0, i, j, k;
+   RTdimensionindex d, e;
+
+   /*Subtrees of different heights: the taller one goes down alone*/
+   if (P->LevelA > P->LevelB) {
+      OverlapMask(P->A, P->B->I, mask);
+      while ((i = NextChild(mask)) < M)
+         JoinPush(P->A->Child + i, P->B, P->LevelA - 1, P->LevelB, list, n, capacity);
+      return true;
+   }
+   if (P->LevelB > P->LevelA) {
+      OverlapMask(P->B, P->A->I, mask);
+      while ((i = NextChild(mask)) < M)
+         JoinPush(P->A, P->B->Child + i, P->LevelA, P->LevelB - 1, list, n, capacity);
+      return true;
+   }
+
+   /*Only children overlapping both covers can meet*/
+   for (d = 0, e = RTn; d < RTn; ++d, ++e) {
+      X[d] = P->A->I[d] > P->B->I[d] ? P->A->I[d] : P->B->I[d];
+      X[e] = P->A->I[e] < P->B->I[e] ? P->A->I[e] : P->B->I[e];
+   }
+   OverlapMask(P->A, X, mask);
+   while ((i = NextChild(mask)) < M)
+      a[na++] = P->A->Child + i;
+   OverlapMask(P->B, X, mask);
+   while ((i = NextChild(mask)) < M)
+      b[nb++] = P->B->Child + i;
+
+   /*Plane sweep along the first dimension: the child with the lowest side meets those of the other node starting before its end*/
+   qsort(a, na, sizeof(a[0]), JoinCompare);
+   qsort(b, nb, sizeof(b[0]), JoinCompare);
+   for (i = 0, j = 0; i < na && j < nb; )
+      if (a[i]->I[0] <= b[j]->I[0]) {
+         for (k = j; k < nb && b[k]->I[0] <= a[i]->I[RTn]; ++k)
+            if (Overlap(a[i]->I, b[k]->I) && !JoinMeet(J, a[i], b[k], P->LevelA, list, n, capacity))
+               return false;
+         ++i;
+      } else {
+         for (k = i; k < na && a[k]->I[0] <= b[j]->I[RTn]; ++k)
+            if (Overlap(a[k]->I, b[j]->I) && !JoinMeet(J, a[k], b[j], P->LevelA, list, n, capacity))
+               return false;
+         ++j;
+      }
+
+   return true;
+}
+
+/*Hands a pair of overlapping entries to the visitor, or lists a pair of overlapping subtrees*/
+/*In: Join, Child of A, Child of B, Level of their parents  Out: Pair List, List Length, List Capacity*/
+static bool JoinMeet(struct Join *J, struct RTNode *A, struct RTNode *B, size_t level, struct JoinPair **list, size_t *n, size_t *capacity) {
+   if (level > LEVEL_LEAF) {
+      JoinPush(A, B, level - 1, level - 1, list, n, capacity);
+      return true;
+   }
+
+   if (J->visit(A->I, A->Tuple, B->I, B->Tuple, J->ctx))
+      return true;
+
+#ifdef LOAD_THREADS
+   __atomic_store_n(&J->Stopped, true, __ATOMIC_RELAXED);
+#else
+   J->Stopped = true;
+#endif
+   return false;
+}
+
+/*Appends a pair to a list, doubling it when full*/
+static void JoinPush(struct RTNode *A, struct RTNode *B, size_t LevelA, size_t LevelB, struct JoinPair **list, size_t *n, size_t *capacity) {
+   if (*n == *capacity) {
+      *capacity = *capacity ? *capacity * 2 : M;
+      *list = (struct JoinPair *)mem_realloc(*list, *capacity * sizeof((*list)[0]));
+   }
+
+   (*list)[*n].A = A;
+   (*list)[*n].B = B;
+   (*list)[*n].LevelA = LevelA;
+   (*list)[*n].LevelB = LevelB;
+   ++*n;
+}
+
+/*Orders children by their lower side in the first dimension*/
+static int JoinCompare(const void *a, const void *b) {
+   const struct RTNode *A = *(struct RTNode *const *)a, *B = *(struct RTNode *const *)b;
+
+   return (A->I[0] > B->I[0]) - (A->I[0] < B->I[0]);
+}
+
+/*Returns true once the visitor has stopped the join*/
+static bool JoinStopped(struct Join *J) {
+#ifdef LOAD_THREADS
+   return __atomic_load_n(&J->Stopped, __ATOMIC_RELAXED);
+#else
+   return J->Stopped;
+#endif
+}
+
+/*Probes the second tree of a join with an entry of the first*/
+static bool JoinOuterVisitor(RTdimension I[], void *Tuple, void *ctx) {
+   struct JoinProbe *probe = (struct JoinProbe *)ctx;
+
+   probe->I = I;
+   probe->Tuple = Tuple;
+   SearchTree(probe->B, I, JoinInnerVisitor, probe, NULL);
+   return !probe->J->Stopped;
+}
+
+/*Hands an entry of the first tree and one of the second overlapping it to the join visitor*/
+static bool JoinInnerVisitor(RTdimension I[], void *Tuple, void *ctx) {
+   struct JoinProbe *probe = (struct JoinProbe *)ctx;
+
+   probe->J->Stopped = !probe->J->visit(probe->I, probe->Tuple, I, Tuple, probe->J->ctx);
+   return !probe->J->Stopped;
+}
+
+/*Opens a cursor over the hits of a search box*/
+/*In: Parent Node, Search Box  Out: Cursor*/
+bool RTOpenCursor(RTreePtr *T, RTdimension S[], struct RTCursor **C) {
+   if (!T || !*T || !(*T)->Root) {
+      fputs("RTree cannot be NULL.\n", stderr);
+      return false;
+   }
+
+   if (!S || !C) {
+      fputs("Must have Search Box and Cursor.\n", stderr);
+      return false;
+   }
+
+   *C = (struct RTCursor *)mem_alloc(sizeof(struct RTCursor));
+   memcpy((*C)->S, S, sizeof((*C)->S));
+   (*C)->Tree = *T;
+   if ((*T)->Config.Sync == RTSyncLink) {
+      (*C)->Slot = RCU_READERS;
+      (*C)->Link = (struct LinkPath *)mem_alloc(sizeof(struct LinkPath));
+      LinkOpen(*T, (*C)->Link);
+      return true;
+   }
+   (*C)->Path.Depth = 1;
+   (*C)->Path.Stack[0].Node = ReadLock(*T, &(*C)->Slot);
+   (*C)->Path.Stack[0].Within = SearchMask((*C)->Path.Stack[0].Node, (*C)->S, false, (*C)->Path.Stack[0].Mask);
+   return true;
+}
+
+/*Fetches up to K more hits; fewer than K means the cursor is exhausted*/
+/*In: Cursor, Hit Limit  Out: Hit Buffer, Hit Count*/
+bool RTFetchCursor(struct RTCursor *C, struct RTResults *results, size_t K, size_t *count) {
+   struct CursorFetch fetch;
+
+   if (!C || !results) {
+      fputs("Must have Cursor and Results.\n", stderr);
+      return false;
+   }
+
+   results->Count = 0;
+   if (count) *count = 0;
+
+   if (K == 0)
+      return true;
+
+   fetch.results = results;
+   fetch.limit = K;
+   if (C->Link ? !LinkResume(C->Tree, C->Link, C->S, OverlapMask, CursorFetchVisitor, &fetch) : !Resume(&C->Path, C->S, CursorFetchVisitor, &fetch, &fetch)) {
+      results->Count = 0;
+      return false;
+   }
+
+   if (count) *count = results->Count;
+   return true;
+}
+
+/*Closes a cursor*/
+bool RTCloseCursor(struct RTCursor **C) {
+   if (!C || !*C)
+      return true;
+
+   ReadUnlock((*C)->Tree, (*C)->Slot);
+   if ((*C)->Link)
+      free((*C)->Link->Wait);
+   free((*C)->Link);
+   free(*C);
+   *C = NULL;
+   return true;
+}
+
+/*Appends hits to the result buffer until the fetch limit is reached*/
+static bool CursorFetchVisitor(RTdimension I[], void *Tuple, void *ctx) {
+   struct CursorFetch *fetch = (struct CursorFetch *)ctx;
+
+   SelectResultsVisitor(I, Tuple, fetch->results);
+   return fetch->results->Count < fetch->limit;
+}
+
+/*Appends n entries of a leaf to the fetch's buffer at once, growing it as SelectResultsVisitor does*/
+static void TakeEntries(struct CursorFetch *fetch, struct RTNode *E, size_t n) {
+   struct RTResults *results = fetch->results;
+   struct RTResult *R;
+   size_t i;
+
+   if (results->Count + n > results->Capacity) {
+      if (!results->Capacity)
+         results->Capacity = RTPS / sizeof(results->Result[0]);
+      while (results->Count + n > results->Capacity)
+         results->Capacity *= 2;
+      results->Result = (struct RTResult *)mem_realloc(results->Result, results->Capacity * sizeof(results->Result[0]));
+   }
+
+   for (R = results->Result + results->Count, i = 0; i < n; ++i, ++R) {
+      memcpy(R->I, E[i].I, sizeof(R->I));
+      R->Tuple = E[i].Tuple;
+      R->Distance = 0;
+   }
+   results->Count += n;
+}
+
+/*Best-first nearest neighbour search (Hjaltason, Samet: Distance Browsing in Spatial Databases)*/
+/*One queue holds subtrees and hits by distance; a hit reaching the front is nearer than anything left*/
+
+/*Finds the K entries nearest a point or box by squared Euclidean distance*/
+/*In: Parent Node, Query Box, Hit Limit  Out: Hit Buffer nearest first, Hit Count*/
+bool RTSelectNearest(RTreePtr *T, RTdimension P[], size_t K, struct RTResults *results, size_t *count) {
+   struct RTNearest *C = NULL;
+   size_t i;
+   bool ok;
+
+   if (!results) {
+      fputs("Must have Results.\n", stderr);
+      return false;
+   }
+
+   results->Count = 0;
+   if (count) *count = 0;
+
+   if (!RTOpenNearest(T, P, NULL, NULL, &C))
+      return false;
+
+   if (K) {
+      /*Only the K nearest hits can be returned, so entries farther than K queued hits never are*/
+      C->Best = (long double *)mem_alloc(K * sizeof(C->Best[0]));
+      C->Limit = K;
+      for (i = 0; i < C->Count; ++i)
+         if (!C->Queue[i].Node->Child)
+            NearBound(C, C->Queue[i].Key);
+   }
+
+   ok = RTFetchNearest(C, results, K, count);
+   RTCloseNearest(&C);
+   return ok;
+}
+
+/*Opens a browse over the entries by increasing distance from a point or box*/
+/*In: Parent Node, Query Box, Distance or NULL for squared Euclidean, Distance Context  Out: Browse*/
+bool RTOpenNearest(RTreePtr *T, RTdimension P[], RTDistance distance, void *ctx, struct RTNearest **C) {
+   struct RTNode root;
+   uint64_t expect;
+
+   if (!T || !*T || !(*T)->Root) {
+      fputs("RTree cannot be NULL.\n", stderr);
+      return false;
+   }
+
+   if (!P || !C) {
+      fputs("Must have Query Box and Browse.\n", stderr);
+      return false;
+   }
+
+   *C = (struct RTNearest *)mem_alloc(sizeof(struct RTNearest));
+   memcpy((*C)->P, P, sizeof((*C)->P));
+   (*C)->Distance = distance;
+   (*C)->ctx = ctx;
+   (*C)->Tree = *T;
+   if ((*T)->Config.Sync == RTSyncLink) {
+      (*C)->Slot = RCU_READERS;
+      expect = LinkRoot(*T, &root);
+      NearExpand(*C, &root, expect);
+   } else
+      NearExpand(*C, ReadLock(*T, &(*C)->Slot), 0);
+   return true;
+}
+
+/*Fetches up to K more hits, nearest first; fewer than K means the browse is exhausted*/
+/*In: Browse, Hit Limit  Out: Hit Buffer, Hit Count*/
+bool RTFetchNearest(struct RTNearest *C, struct RTResults *results, size_t K, size_t *count) {
+   struct RTNode *N;
+   long double key;
+   uint64_t expect;
+
+   if (!C || !results) {
+      fputs("Must have Browse and Results.\n", stderr);
+      return false;
+   }
+
+   results->Count = 0;
+   if (count) *count = 0;
+
+   while (results->Count < K && (N = NearPop(C, &key, &expect))) {
+      if (N->Child) {
+         NearExpand(C, N, expect);
+         continue;
+      }
+
+      SelectResultsVisitor(N->I, N->Tuple, results);
+      results->Result[results->Count-1].Distance = key;
+   }
+
+   if (count) *count = results->Count;
+   return true;
+}
+
+/*Closes a nearest neighbour browse*/
+bool RTCloseNearest(struct RTNearest **C) {
+   struct NearBlock *B;
+
+   if (!C || !*C)
+      return true;
+
+   ReadUnlock((*C)->Tree, (*C)->Slot);
+   while ((B = (*C)->Blocks) != NULL) {
+      (*C)->Blocks = B->Next;
+      free(B);
+   }
+   free((*C)->Queue);
+   free((*C)->Best);
+   free(*C);
+   *C = NULL;
+   return true;
+}
+
+/*Squared Euclidean distance between the closest points of two boxes*/
+static long double MinDist(RTdimension P[], RTdimension I[], void *Tuple, void *ctx) {
+   RTdimensionindex j = 0, k = 0;
+   long double gap, sum = 0;
+
+   (void)Tuple;
+   (void)ctx;
+   for (j = 0, k = RTn; j < RTn; ++j, ++k) {
+      if (I[j] > P[k])
+         gap = (long double)I[j] - P[k];
+      else if (P[j] > I[k])
+         gap = (long double)P[j] - I[k];
+      else
+         continue;
+      sum += gap * gap;
+   }
+
+   return sum;
+}
+
+/*Distance of a queued entry from the query*/
+static long double NearKey(struct RTNearest *C, struct RTNode *E) {
+   if (C->Distance)
+      return C->Distance(C->P, E->I, E->Child ? NULL : E->Tuple, C->ctx);
+
+   return MinDist(C->P, E->I, NULL, NULL);
+}
+
+/*Queues the children of a node, hits by their own distance*/
+/*In: Browse, Node, Sequence Number its Parent was read at*/
+static void NearExpand(struct RTNearest *C, struct RTNode *N, uint64_t Expect) {
+   struct RTNode *E, *Child = N->Child;
+   struct NearBlock *B;
+   long double key;
+   RTchildindex i, n = M;
+   uint64_t expect = Expect;
+
+   /*RTSyncLink trees are read into copies kept until the browse closes*/
+   if (C->Tree->Config.Sync == RTSyncLink) {
+      B = (struct NearBlock *)mem_alloc(sizeof(struct NearBlock));
+      B->Next = C->Blocks;
+      C->Blocks = B;
+      LinkRead(C->Tree, N->Child, Expect, NULL, NULL, &B->Node);
+      Child = B->Node.Child;
+      n = B->Node.Count;
+      expect = B->Node.Expect;
+
+      /*The entries split off lay within the node they left*/
+      if (B->Node.Right) {
+         B->Right = *N;
+         B->Right.Child = B->Node.Right;
+         NearPush(C, NearKey(C, N), &B->Right, Expect);
+      }
+   }
+
+   for (i = 0; i < n && !IS_EMPTY(Child[i]); ++i) {
+      E = Child+i;
+      key = NearKey(C, E);
+      if (C->Kept == C->Limit && C->Limit && key > C->Best[0])
+         continue;
+
+      NearPush(C, key, E, expect);
+      if (C->Limit && !E->Child)
+         NearBound(C, key);
+   }
+}
+
+/*Records a queued hit distance, keeping the Limit nearest*/
+static void NearBound(struct RTNearest *C, long double Key) {
+   size_t i, up, down;
+
+   if (C->Kept < C->Limit) {
+      for (i = C->Kept++; i > 0 && C->Best[up = (i-1) / 2] < Key; i = up)
+         C->Best[i] = C->Best[up];
+      C->Best[i] = Key;
+      return;
+   }
+
+   if (Key >= C->Best[0])
+      return;
+
+   for (i = 0; (down = i*2 + 1) < C->Kept; i = down) {
+      if (down+1 < C->Kept && C->Best[down+1] > C->Best[down])
+         ++down;
+      if (C->Best[down] <= Key)
+         break;
+      C->Best[i] = C->Best[down];
+   }
+   C->Best[i] = Key;
+}
+
+/*Adds an entry to the queue*/
+static void NearPush(struct RTNearest *C, long double Key, struct RTNode *N, uint64_t Expect) {
+   size_t i, up;
+
+   if (C->Count == C->Capacity) {
+      C->Capacity = C->Capacity ? C->Capacity * 2 : RTPS / sizeof(C->Queue[0]);
+      C->Queue = (struct NearEntry *)mem_realloc(C->Queue, C->Capacity * sizeof(C->Queue[0]));
+   }
+
+   for (i = C->Count++; i > 0 && C->Queue[up = (i-1) / 2].Key > Key; i = up)
+      C->Queue[i] = C->Queue[up];
+   C->Queue[i].Key = Key;
+   C->Queue[i].Node = N;
+   C->Queue[i].Expect = Expect;
+}
+
+/*Removes the nearest entry from the queue; NULL once it is empty*/
+static struct RTNode *NearPop(struct RTNearest *C, long double *Key, uint64_t *Expect) {
+   struct NearEntry last;
+   struct RTNode *N;
+   size_t i, down;
+
+   if (!C->Count)
+      return NULL;
+
+   N = C->Queue[0].Node;
+   *Key = C->Queue[0].Key;
+   *Expect = C->Queue[0].Expect;
+   last = C->Queue[--C->Count];
+   for (i = 0; (down = i*2 + 1) < C->Count; i = down) {
+      if (down+1 < C->Count && C->Queue[down+1].Key < C->Queue[down].Key)
+         ++down;
+      if (C->Queue[down].Key >= last.Key)
+         break;
+      C->Queue[i] = C->Queue[down];
+   }
+   C->Queue[i] = last;
+   return N;
+}
+
+/*Writes the tree to a file whose nodes refer to each other by offset, for RTOpenMapped*/
+/*Each Tuple is stored as the id given for it, or as its pointer value without an id function*/
+/*The file is written beside the old one and renamed over it, so open mappings keep the old tree*/
+/*In: Parent Node, File Name, Tuple Id, Id Context*/
+bool RTSaveTree(RTreePtr *T, const char *filename, RTTupleId id, void *ctx) {
+   struct MapHeader header;
+   struct MapNode *node;
+   struct MapEntry *entry;
+   struct RTNode **queue, *N;
+   uint64_t *offset;
+   size_t count, capacity, next, k, slot;
+   RTchildindex i, n;
+   char *temp;
+   FILE *file;
+   bool ok;
+
+   if (!T || !*T || !(*T)->Root) {
+      fputs("RTree cannot be NULL.\n", stderr);
+      return false;
+   }
+
+   if (!filename) {
+      fputs("Must have File Name.\n", stderr);
+      return false;
+   }
+
+   temp = (char *)mem_alloc(strlen(filename) + sizeof(".tmp"));
+   strcat(strcpy(temp, filename), ".tmp");
+   if ((file = fopen(temp, "wb")) == NULL) {
+      fprintf(stderr, "Cannot write %s.\n", temp);
+      free(temp);
+      return false;
+   }
+
+   memset(&header, 0, sizeof(header));
+   memcpy(header.Magic, MAP_MAGIC, sizeof(header.Magic));
+   header.Version = MAP_VERSION;
+   header.Order = MAP_ORDER;
+   header.Dimensions = RTn;
+   header.Coordinate = (uint32_t)sizeof(RTdimension) | (GRAIN ? MAP_INTEGER : 0);
+
+   /*Nodes in level order, so every node's children follow each other and the upper levels lead the file*/
+   capacity = RTPS / sizeof(queue[0]);
+   queue = (struct RTNode **)mem_realloc(NULL, capacity * sizeof(queue[0]));
+   offset = (uint64_t *)mem_realloc(NULL, capacity * sizeof(offset[0]));
+   queue[0] = ReadLock(*T, &slot);
+   memcpy(header.I, queue[0]->I, sizeof(header.I));
+   for (header.Height = 1, N = queue[0]; N->Child && N->Child[0].Child; N = N->Child)
+      ++header.Height;
+
+   header.Size = sizeof(header);
+   for (count = 1, k = 0; k < count; ++k) {
+      N = queue[k];
+      n = N->Child ? CountChildren(N) : 0;
+      offset[k] = header.Size;
+      header.Size += sizeof(struct MapNode) + n * sizeof(struct MapEntry);
+
+      if (n && N->Child[0].Child)
+         for (i = 0; i < n; ++i) {
+            if (count == capacity) {
+               capacity *= 2;
+               queue = (struct RTNode **)mem_realloc(queue, capacity * sizeof(queue[0]));
+               offset = (uint64_t *)mem_realloc(offset, capacity * sizeof(offset[0]));
+            }
+            queue[count++] = N->Child + i;
+         }
+      else
+         header.Entries += n;
+   }
+   header.Nodes = count;
+   header.Root = offset[0];
+
+   ok = fwrite(&header, sizeof(header), 1, file) == 1;
+   node = (struct MapNode *)mem_alloc(sizeof(struct MapNode) + M * sizeof(struct MapEntry));
+   entry = (struct MapEntry *)(node + 1);
+   for (k = 0, next = 1; ok && k < count; ++k) {
+      N = queue[k];
+      n = N->Child ? CountChildren(N) : 0;
+      node->Count = n;
+      node->Leaf = !n || !N->Child[0].Child;
+      for (i = 0; i < n; ++i) {
+         memcpy(entry[i].I, N->Child[i].I, sizeof(entry[i].I));
+         if (node->Leaf)
+            entry[i].Ref = id ? id(N->Child[i].Tuple, ctx) : (uint64_t)(uintptr_t)N->Child[i].Tuple;
+         else
+            entry[i].Ref = offset[next++];
+      }
+      ok = fwrite(node, sizeof(struct MapNode) + n * sizeof(struct MapEntry), 1, file) == 1;
+   }
+   ReadUnlock(*T, slot);
+
+   free(node);
+   free(queue);
+   free(offset);
+   ok = fclose(file) == 0 && ok;
+   if (!ok || rename(temp, filename) != 0) {
+      fprintf(stderr, "Cannot write %s.\n", filename);
+      remove(temp);
+      free(temp);
+      return false;
+   }
+
+   free(temp);
+   return true;
+}
+/*Opens a tree saved by RTSaveTree read only, searching the file's pages where they lie*/
+/*In: File Name  Out: Mapped Tree*/
+bool RTOpenMapped(struct RTMapped **T, const char *filename) {
+   const struct MapHeader *header;
+   struct RTMapped map;
+#ifdef FILE_MMAP
+   struct stat st;
+   void *mem;
+   int fd;
+#else
+   FILE *file;
+   long size;
+#endif
+
+   if (!T || !filename) {
+      fputs("Must have Mapped Tree and File Name.\n", stderr);
+      return false;
+   }
+   *T = NULL;
+
+#ifdef FILE_MMAP
+   /*Processes mapping one file share its pages*/
+   if ((fd = open(filename, O_RDONLY)) < 0) {
+      fprintf(stderr, "Cannot read %s.\n", filename);
+      return false;
+   }
+   if (fstat(fd, &st) != 0 || (size_t)st.st_size < sizeof(struct MapHeader)
+         || (mem = mmap(NULL, (size_t)st.st_size, PROT_READ, MAP_SHARED, fd, 0)) == MAP_FAILED) {
+      fprintf(stderr, "Cannot map %s.\n", filename);
+      close(fd);
+      return false;
+   }
+   close(fd);
+   map.Base = (const unsigned char *)mem;
+   map.Size = (size_t)st.st_size;
+   map.Mapped = true;
+#else
+   if ((file = fopen(filename, "rb")) == NULL) {
+      fprintf(stderr, "Cannot read %s.\n", filename);
+      return false;
+   }
+   if (fseek(file, 0, SEEK_END) != 0 || (size = ftell(file)) < (long)sizeof(struct MapHeader) || fseek(file, 0, SEEK_SET) != 0) {
+      fprintf(stderr, "Cannot read %s.\n", filename);
+      fclose(file);
+      return false;
+   }
+   map.Base = (const unsigned char *)mem_alloc((size_t)size);
+   map.Size = (size_t)size;
+   map.Mapped = false;
+   if (fread((void *)map.Base, map.Size, 1, file) != 1) {
+      fprintf(stderr, "Cannot read %s.\n", filename);
+      free((void *)map.Base);
+      fclose(file);
+      return false;
+   }
+   fclose(file);
+#endif
+
+   header = (const struct MapHeader *)map.Base;
+   if (memcmp(header->Magic, MAP_MAGIC, sizeof(header->Magic)) || header->Version != MAP_VERSION || header->Order != MAP_ORDER
+         || header->Dimensions != RTn || header->Coordinate != ((uint32_t)sizeof(RTdimension) | (GRAIN ? MAP_INTEGER : 0))
+         || header->Size != map.Size || header->Height > MAX_HEIGHT || !MapNodeAt(&map, header->Root)) {
+      fprintf(stderr, "%s is not a tree of this shape saved on this machine.\n", filename);
+      MapRelease(&map);
+      return false;
+   }
+
+   *T = (struct RTMapped *)mem_alloc(sizeof(struct RTMapped));
+   **T = map;
+   return true;
+}
+
+/*Calls the visitor for every hit of a mapped tree until it returns false*/
+/*In: Mapped Tree, Search Box, Visitor, Visitor Context*/
+bool RTSelectMapped(struct RTMapped *T, RTdimension S[], RTMappedVisitor visit, void *ctx) {
+   const struct MapHeader *header;
+   const struct MapNode *N;
+   const struct MapEntry *E;
+   RTdimension I[RTn*2];
+   struct {
+      const struct MapNode *Node;
+      uint32_t Next; /*first entry not yet tested*/
+   } stack[MAX_HEIGHT];
+   size_t depth;
+   uint32_t i;
+
+   if (!T || !S || !visit) {
+      fputs("Must have Mapped Tree, Search Box and Visitor.\n", stderr);
+      return false;
+   }
+
+   header = (const struct MapHeader *)T->Base;
+   if (!header->Entries || !Overlap((RTdimension *)header->I, S))
+      return true;
+
+   depth = 1;
+   stack[0].Node = MapNodeAt(T, header->Root);
+   stack[0].Next = 0;
+   while (depth) {
+      N = stack[depth-1].Node;
+      E = (const struct MapEntry *)(N + 1);
+
+      /*S2 [Search leaf node]*/
+      if (N->Leaf) {
+         for (i = stack[depth-1].Next; i < N->Count; ++i)
+            if (Overlap((RTdimension *)E[i].I, S)) {
+               /*The visitor gets a copy; the mapped pages are read only*/
+               memcpy(I, E[i].I, sizeof(I));
+               if (!visit(I, E[i].Ref, ctx))
+                  return true;
+            }
+         --depth;
+         continue;
+      }
+
+      /*S1 [Search subtrees]*/
+      for (i = stack[depth-1].Next; i < N->Count && !Overlap((RTdimension *)E[i].I, S); ++i) ;
+      if (i == N->Count) {
+         --depth;
+         continue;
+      }
+      stack[depth-1].Next = i + 1;
+
+      if (depth == MAX_HEIGHT || (stack[depth].Node = MapNodeAt(T, E[i].Ref)) == NULL) {
+         fputs("Mapped tree is damaged.\n", stderr);
+         return false;
+      }
+      stack[depth].Next = 0;
+      ++depth;
+   }
+
+   return true;
+}
+
+/*Closes a mapped tree*/
+bool RTCloseMapped(struct RTMapped **T) {
+   if (!T || !*T)
+      return true;
+
+   MapRelease(*T);
+   free(*T);
+   *T = NULL;
+   return true;
+}
+
+/*Gives back the pages of a mapped tree*/
+static void MapRelease(const struct RTMapped *T) {
+#ifdef FILE_MMAP
+   if (T->Mapped)
+      munmap((void *)T->Base, T->Size);
+   else
+#endif
+      free((void *)T->Base);
+}
+
+/*Node at an offset of a mapped tree, or NULL if it doesn't fit in the file*/
+static const struct MapNode *MapNodeAt(const struct RTMapped *T, uint64_t offset) {
+   const struct MapNode *N;
+
+   if (offset % sizeof(uint64_t) || offset < sizeof(struct MapHeader) || offset > T->Size - sizeof(struct MapNode))
+      return NULL;
+
+   N = (const struct MapNode *)(T->Base + offset);
+   if (N->Count > (T->Size - offset - sizeof(struct MapNode)) / sizeof(struct MapEntry))
+      return NULL;
+   return N;
+}
+
+/*Opens a paged tree, creating the file if it doesn't exist, with a pool of the given number of frames*/
+/*Only the pages in the pool are in memory; callers serialize every call on one tree*/
+/*In: File Name, Frames  Out: Paged Tree*/
+bool RTOpenPaged(struct RTPaged **T, const char *filename, size_t frames) {
+   struct RTPaged *P;
+   struct PageNode *N;
+#ifdef FILE_MMAP
+   struct stat st;
+#endif
+   unsigned char *page;
+   size_t i;
+   bool empty, ok;
+
+   if (!T || !filename) {
+      fputs("Must have Paged Tree and File Name.\n", stderr);
+      return false;
+   }
+   *T = NULL;
+
+   if (frames < PAGE_FRAMES) {
+      fprintf(stderr, "Frames must be at least %d.\n", PAGE_FRAMES);
+      return false;
+   }
+
+   P = (struct RTPaged *)mem_alloc(sizeof(struct RTPaged));
+#ifdef FILE_MMAP
+   P->File = open(filename, O_RDWR | O_CREAT, 0644);
+   ok = P->File >= 0;
+#else
+   if ((P->File = fopen(filename, "r+b")) == NULL)
+      P->File = fopen(filename, "w+b");
+   ok = P->File != NULL;
+#endif
+   if (!ok) {
+      fprintf(stderr, "Cannot open %s.\n", filename);
+      free(P);
+      return false;
+   }
+
+   P->Frames = frames;
+   P->Data = (unsigned char *)mem_alloc(frames * RTPS);
+   P->Frame = (struct PageFrame *)mem_alloc(frames * sizeof(P->Frame[0]));
+   for (P->Buckets = 1; P->Buckets < frames; P->Buckets *= 2) ;
+   P->Bucket = (size_t *)mem_alloc(P->Buckets * sizeof(P->Bucket[0]));
+   for (i = 0; i < P->Buckets; ++i)
+      P->Bucket[i] = frames;
+   P->Stats.Frames = frames;
+
+   /*An empty file gets a header and an empty root leaf*/
+#ifdef FILE_MMAP
+   empty = fstat(P->File, &st) == 0 && st.st_size == 0;
+#else
+   empty = fseek(P->File, 0, SEEK_END) == 0 && ftell(P->File) == 0;
+#endif
+   page = (unsigned char *)mem_alloc(RTPS);
+   if (empty) {
+      memcpy(P->Header.Magic, PAGE_MAGIC, sizeof(P->Header.Magic));
+      P->Header.Version = PAGE_VERSION;
+      P->Header.Order = MAP_ORDER;
+      P->Header.Dimensions = RTn;
+      P->Header.Coordinate = (uint32_t)sizeof(RTdimension) | (GRAIN ? MAP_INTEGER : 0);
+      P->Header.PageSize = RTPS;
+      P->Header.Pages = 1;
+      P->Header.Height = 1;
+      ok = (N = PageAlloc(P, &P->Header.Root)) != NULL;
+      if (ok) {
+         N->Leaf = 1;
+         PageUnpin(P, N, true);
+         ok = PageFlush(P);
+      }
+   } else {
+      ok = PageIO(P, 0, page, false);
+      memcpy(&P->Header, page, sizeof(P->Header));
+      ok = ok && !memcmp(P->Header.Magic, PAGE_MAGIC, sizeof(P->Header.Magic)) && P->Header.Version == PAGE_VERSION
+            && P->Header.Order == MAP_ORDER && P->Header.Dimensions == RTn && P->Header.PageSize == RTPS
+            && P->Header.Coordinate == ((uint32_t)sizeof(RTdimension) | (GRAIN ? MAP_INTEGER : 0))
+            && P->Header.Height && P->Header.Height < MAX_HEIGHT && P->Header.Root && P->Header.Root < P->Header.Pages;
+      if (!ok)
+         fprintf(stderr, "%s is not a paged tree of this shape saved on this machine.\n", filename);
+   }
+   free(page);
+
+   if (!ok) {
+      PageRelease(P);
+      return false;
+   }
+
+   *T = P;
+   return true;
+}
+
+/*Writes back the dirty pages and the header, and waits for the file to reach the disk*/
+bool RTFlushPaged(struct RTPaged *T) {
+   if (!T) {
+      fputs("Paged Tree cannot be NULL.\n", stderr);
+      return false;
+   }
+
+   if (!PageFlush(T))
+      return false;
+#ifdef FILE_MMAP
+   return fsync(T->File) == 0;
+#else
+   return fflush(T->File) == 0;
+#endif
+}
+
+/*Writes back the dirty pages and closes a paged tree*/
+bool RTClosePaged(struct RTPaged **T) {
+   bool ok;
+
+   if (!T || !*T)
+      return true;
+
+   ok = PageFlush(*T);
+   PageRelease(*T);
+   *T = NULL;
+   return ok;
+}
+
+/*Reports the buffer pool's hits and misses, write backs and evictions*/
+bool RTSelectPageStats(struct RTPaged *T, struct RTPageStats *stats) {
+   if (!T || !stats) {
+      fputs("Must have Paged Tree and Stats.\n", stderr);
+      return false;
+   }
+
+   *stats = T->Stats;
+   stats->Pages = T->Header.Pages;
+   return true;
+}
+
+/*Calls the visitor for every hit of a paged tree until it returns false*/
+/*In: Paged Tree, Search Box, Visitor, Visitor Context*/
+bool RTSelectPaged(struct RTPaged *T, RTdimension S[], RTMappedVisitor visit, void *ctx) {
+   struct {
+      struct PageNode *Node;
+      uint32_t Next; /*first entry not yet tested*/
+   } stack[MAX_HEIGHT];
+   struct PageNode *N;
+   struct MapEntry *E;
+   RTdimension I[RTn*2];
+   size_t depth;
+   uint32_t i;
+   bool ok = true;
+
+   if (!T || !S || !visit) {
+      fputs("Must have Paged Tree, Search Box and Visitor.\n", stderr);
+      return false;
+   }
+
+   if ((stack[0].Node = PagePin(T, T->Header.Root)) == NULL)
+      return false;
+   stack[0].Next = 0;
+
+   /*The pages of the path stay pinned*/
+   for (depth = 1; depth; ) {
+      N = stack[depth-1].Node;
+      E = (struct MapEntry *)(N + 1);
+
+      /*S2 [Search leaf node]*/
+      if (N->Leaf) {
+         for (i = stack[depth-1].Next; i < N->Count; ++i)
+            if (Overlap(E[i].I, S)) {
+               /*The visitor gets a copy; the frame may hold another page by the time it returns*/
+               memcpy(I, E[i].I, sizeof(I));
+               if (!visit(I, E[i].Ref, ctx))
+                  break;
+            }
+         if (i < N->Count)
+            break;
+         PageUnpin(T, N, false);
+         --depth;
+         continue;
+      }
+
+      /*S1 [Search subtrees]*/
+      for (i = stack[depth-1].Next; i < N->Count && !Overlap(E[i].I, S); ++i) ;
+      if (i == N->Count) {
+         PageUnpin(T, N, false);
+         --depth;
+         continue;
+      }
+      stack[depth-1].Next = i + 1;
+
+      if (depth == MAX_HEIGHT || (stack[depth].Node = PagePin(T, E[i].Ref)) == NULL) {
+         ok = false;
+         break;
+      }
+      stack[depth].Next = 0;
+      ++depth;
+   }
+
+   while (depth)
+      PageUnpin(T, stack[--depth].Node, false);
+   return ok;
+}
+
+/*Inserts an entry into a paged tree*/
+/*In: Paged Tree, Size, Tuple Id*/
+bool RTInsertPaged(struct RTPaged *T, RTdimension I[], uint64_t Id) {
+   struct MapEntry E;
+
+   if (!T || !I) {
+      fputs("Must have Paged Tree and Size.\n", stderr);
+      return false;
+   }
+
+   memcpy(E.I, I, sizeof(E.I));
+   E.Ref = Id;
+   if (!PageInsert(T, &E, 0))
+      return false;
+
+   ++T->Header.Entries;
+   return true;
+}
+
+/*Deletes an entry from a paged tree*/
+/*In: Paged Tree, Size, Tuple Id*/
+bool RTDeletePaged(struct RTPaged *T, RTdimension I[], uint64_t Id) {
+   if (!T || !I) {
+      fputs("Must have Paged Tree and Size.\n", stderr);
+      return false;
+   }
+
+   if (!PageDelete(T, I, Id))
+      return false;
+
+   --T->Header.Entries;
+   return true;
+}
+
+/*Reads or writes one page of the file*/
+static bool PageIO(struct RTPaged *T, uint64_t page, void *buf, bool write) {
+#ifdef FILE_MMAP
+   off_t at = (off_t)(page * RTPS);
+
+   if (write)
+      return pwrite(T->File, buf, RTPS, at) == (ssize_t)RTPS;
+   return pread(T->File, buf, RTPS, at) == (ssize_t)RTPS;
+#else
+   if (fseek(T->File, (long)(page * RTPS), SEEK_SET) != 0)
+      return false;
+   if (write)
+      return fwrite(buf, RTPS, 1, T->File) == 1;
+   return fread(buf, RTPS, 1, T->File) == 1;
+#endif
+}
+
+/*Closes the file of a paged tree and frees its pool*/
+static void PageRelease(struct RTPaged *T) {
+#ifdef FILE_MMAP
+   close(T->File);
+#else
+   fclose(T->File);
+#endif
+   free(T->Data);
+   free(T->Frame);
+   free(T->Bucket);
+   free(T);
+}
+
+#define PAGE_BUCKET(T, page) ((size_t)(((page) * 0x9E3779B97F4A7C15u) >> 20) & ((T)->Buckets - 1))
+
+/*Frame holding a page, or Frames if it isn't in the pool*/
+static size_t PageFind(struct RTPaged *T, uint64_t page) {
+   size_t f;
+
+   for (f = T->Bucket[PAGE_BUCKET(T, page)]; f < T->Frames && T->Frame[f].Page != page; f = T->Frame[f].Next) ;
+   return f;
+}
+
+/*Frees a frame for a page by the clock algorithm, writing back the page it held if dirty*/
+/*Returns Frames when every frame is pinned or the write back fails*/
+static size_t PageFrameFor(struct RTPaged *T, uint64_t page) {
+   struct PageFrame *F;
+   size_t f, *link, turns;
+
+   /*Two turns clear every reference bit, so a frame is found unless all are pinned*/
+   for (turns = 0; turns < 2 * T->Frames; ++turns) {
+      f = T->Hand;
+      T->Hand = (T->Hand + 1) % T->Frames;
+      F = T->Frame + f;
+      if (F->Pins)
+         continue;
+      if (F->Used) {
+         F->Used = false;
+         continue;
+      }
+
+      if (F->Page) {
+         if (F->Dirty) {
+            if (!PageIO(T, F->Page, T->Data + f * RTPS, true)) {
+               fputs("Cannot write back a page.\n", stderr);
+               return T->Frames;
+            }
+            ++T->Stats.Writes;
+         }
+         for (link = &T->Bucket[PAGE_BUCKET(T, F->Page)]; *link != f; link = &T->Frame[*link].Next) ;
+         *link = F->Next;
+         ++T->Stats.Evictions;
+      }
+
+      F->Page = page;
+      F->Dirty = false;
+      F->Next = T->Bucket[PAGE_BUCKET(T, page)];
+      T->Bucket[PAGE_BUCKET(T, page)] = f;
+      return f;
+   }
+
+   fputs("Every frame is pinned.\n", stderr);
+   return T->Frames;
+}
+
+/*Pins a page in the pool, reading it on a miss*/
+static struct PageNode *PagePin(struct RTPaged *T, uint64_t page) {
+   size_t f = PageFind(T, page);
+
+   if (f < T->Frames)
+      ++T->Stats.Hits;
+   else {
+      if (page == 0 || page >= T->Header.Pages || (f = PageFrameFor(T, page)) == T->Frames)
+         return NULL;
+      if (!PageIO(T, page, T->Data + f * RTPS, false)) {
+         fputs("Cannot read a page.\n", stderr);
+         T->Frame[f].Page = 0;
+         T->Bucket[PAGE_BUCKET(T, page)] = T->Frame[f].Next;
+         return NULL;
+      }
+      ++T->Stats.Misses;
+   }
+
+   ++T->Frame[f].Pins;
+   T->Frame[f].Used = true;
+   return (struct PageNode *)(T->Data + f * RTPS);
+}
+
+/*Pins a new empty page, from the free list or the end of the file*/
+static struct PageNode *PageAlloc(struct RTPaged *T, uint64_t *page) {
+   struct PageNode *N;
+   size_t f;
+
+   if (T->Header.Free) {
+      if ((N = PagePin(T, T->Header.Free)) == NULL)
+         return NULL;
+      *page = T->Header.Free;
+      T->Header.Free = N->Next;
+   } else {
+      if ((f = PageFrameFor(T, T->Header.Pages)) == T->Frames)
+         return NULL;
+      *page = T->Header.Pages++;
+      ++T->Frame[f].Pins;
+      T->Frame[f].Used = true;
+      N = (struct PageNode *)(T->Data + f * RTPS);
+   }
+
+   memset(N, 0, RTPS);
+   T->Frame[((unsigned char *)N - T->Data) / RTPS].Dirty = true;
+   return N;
+}
+
+/*Unpins a page, marking it for write back if it changed*/
+static void PageUnpin(struct RTPaged *T, struct PageNode *N, bool dirty) {
+   struct PageFrame *F = T->Frame + ((unsigned char *)N - T->Data) / RTPS;
+
+   --F->Pins;
+   F->Dirty = F->Dirty || dirty;
+}
+
+/*Unpins a page and puts it on the free list*/
+static void PageDrop(struct RTPaged *T, struct PageNode *N, uint64_t page) {
+   N->Count = 0;
+   N->Next = T->Header.Free;
+   T->Header.Free = page;
+   PageUnpin(T, N, true);
+}
+
+/*Writes back every dirty page and the header*/
+static bool PageFlush(struct RTPaged *T) {
+   unsigned char *page;
+   size_t f;
+   bool ok = true;
+
+   for (f = 0; f < T->Frames; ++f)
+      if (T->Frame[f].Page && T->Frame[f].Dirty) {
+         if (!PageIO(T, T->Frame[f].Page, T->Data + f * RTPS, true)) {
+            ok = false;
+            continue;
+         }
+         T->Frame[f].Dirty = false;
+         ++T->Stats.Writes;
+      }
+
+   page = (unsigned char *)mem_alloc(RTPS);
+   memcpy(page, &T->Header, sizeof(T->Header));
+   ok = PageIO(T, 0, page, true) && ok;
+   free(page);
+
+   if (!ok)
+      fputs("Cannot write back a page.\n", stderr);
+   return ok;
+}
+
+/*Cover of the entries of a page*/
+static void PageCover(const struct PageNode *N, RTdimension I[]) {
+   const struct MapEntry *E = (const struct MapEntry *)(N + 1);
+   RTdimensionindex j, k;
+   uint32_t i;
+
+   memset(I, 0, RTn * 2 * sizeof(I[0]));
+   for (i = 0; i < N->Count; ++i)
+      if (i == 0)
+         memcpy(I, E[0].I, RTn * 2 * sizeof(I[0]));
+      else
+         for (j = 0, k = RTn; j < RTn; ++j, ++k) {
+            if (I[j] > E[i].I[j])
+               I[j] = E[i].I[j];
+            if (I[k] < E[i].I[k])
+               I[k] = E[i].I[k];
+         }
+}
+
+/*3.2 Insertion on pages*/
+/*In: Paged Tree, Entry, Level of the page it goes into; leaves are level 0*/
+static bool PageInsert(struct RTPaged *T, const struct MapEntry *E, uint64_t level) {
+   struct PageNode *path[MAX_HEIGHT], *N, *root;
+   struct MapEntry *C, entry = *E, split;
+   RTdimension cover[RTn*2];
+   uint32_t slot[MAX_HEIGHT], i;
+   uint64_t page;
+   size_t depth, d;
+   long double area, increase, min, minarea;
+   bool dirty[MAX_HEIGHT], pending = true, ok = true;
+
+   if ((path[0] = PagePin(T, T->Header.Root)) == NULL)
+      return false;
+   dirty[0] = false;
+
+   /*I1 [Find position for new record]; the pages of the path stay pinned*/
+   for (depth = 1; depth < T->Header.Height - level; ++depth) {
+      N = path[depth-1];
+      C = (struct MapEntry *)(N + 1);
+
+      /*CL3 [Choose subtree]: least enlargement, then smallest area*/
+      min = LDBL_MAX;
+      minarea = LDBL_MAX;
+      for (slot[depth-1] = 0, i = 0; i < N->Count; ++i) {
+         area = Volume(C[i].I);
+         increase = Enlargement(C[i].I, entry.I);
+         if (increase < min || (increase == min && area < minarea)) {
+            min = increase;
+            minarea = area;
+            slot[depth-1] = i;
+         }
+      }
+
+      /*CL4 [Descend until the level is reached]*/
+      if (N->Count == 0 || (path[depth] = PagePin(T, C[slot[depth-1]].Ref)) == NULL) {
+         ok = false;
+         break;
+      }
+      dirty[depth] = false;
+   }
+
+   for (d = depth; d-- > 0; ) {
+      N = path[d];
+
+      /*I2 [Add record to leaf node], splitting a full page*/
+      /*AT4 [Propagate node split upward]*/
+      if (ok && pending) {
+         dirty[d] = true;
+         if (N->Count < PAGE_MAX) {
+            ((struct MapEntry *)(N + 1))[N->Count++] = entry;
+            pending = false;
+         } else if (PageSplit(T, N, &entry, &split))
+            entry = split;
+         else
+            ok = false;
+      }
 
-         for (j = 0, k = RTn; j < RTn; ++j, ++k) {
-            node->I[j] = node->I[j] < nodelist->I[j] ? node->I[j] : nodelist->I[j];
-            node->I[k] = node->I[k] > nodelist->I[k] ? node->I[k] : nodelist->I[k];
+      /*AT3 [Adjust covering rectangle in parent entry]*/
+      if (ok && d > 0) {
+         C = (struct MapEntry *)(path[d-1] + 1) + slot[d-1];
+         PageCover(N, cover);
+         if (memcmp(cover, C->I, sizeof(cover))) {
+            memcpy(C->I, cover, sizeof(cover));
+            dirty[d-1] = true;
          }
+      }
 
-         nodelist = nodelist->Next;
+      /*I4 [Grow tree taller]*/
+      if (ok && pending && d == 0) {
+         if ((root = PageAlloc(T, &page)) == NULL)
+            ok = false;
+         else {
+            C = (struct MapEntry *)(root + 1);
+            C[0].Ref = T->Header.Root;
+            PageCover(N, C[0].I);
+            C[1] = entry;
+            root->Count = 2;
+            T->Header.Root = page;
+            ++T->Header.Height;
+            PageUnpin(T, root, true);
+         }
       }
 
-      node->Parent = stack;
-      stack = node;
+      PageUnpin(T, N, dirty[d]);
    }
 
-   while (stack && stack->Parent != NULL) {
-      branch = stack;
-      stack_next = NULL;
-      while(branch != NULL) {
-         node = (struct RTNode *)mem_alloc(sizeof(struct RTNode));
-         InitNodes(node, 1);
-         node->Child = (struct RTNode *)mem_alloc(M * sizeof((*T)->Child[0]));
-         InitNodes(node->Child, M);
-
-         memcpy(node->I, branch->I, sizeof(node->I));
-         for (i = 0; branch != NULL && i < M; ++i) {
-            branch_next = branch->Parent;
+   return ok;
+}
 
-            memcpy(node->Child+i, branch, sizeof(node->Child[i]));
-            node->Child[i].Parent = node;
+/*Algorithm LinearSplit on a full page and one more entry*/
+/*In: Paged Tree, Full Page, Extra Entry  Out: Entry of the new page*/
+static bool PageSplit(struct RTPaged *T, struct PageNode *N, const struct MapEntry *E, struct MapEntry *split) {
+   struct MapEntry NL[PAGE_MAX+1], *C = (struct MapEntry *)(N + 1), *LE;
+   struct PageNode *LL;
+   RTdimension Lcover[RTn*2], LLcover[RTn*2], Lexpanded[RTn*2], LLexpanded[RTn*2];
+   size_t i, A = 1, B = 1, n = PAGE_MAX + 1, low, high, seedA = 0, seedB = 1;
+   RTdimensionindex j, k;
+   long double width, separation, sbest = -1.0, Larea, LLarea, Lincrease, LLincrease;
+   bool toL;
 
-            if (node->Child[i].Child != NULL)
-               for (h = 0; h < M && !IS_EMPTY(node->Child[i].Child[h]); ++h)
-                  node->Child[i].Child[h].Parent = node->Child+i;
+   memcpy(NL, C, PAGE_MAX * sizeof(NL[0]));
+   NL[PAGE_MAX] = *E;
 
-            for (j = 0, k = RTn; j < RTn; ++j, ++k) {
-               node->I[j] = node->I[j] < branch->I[j] ? node->I[j] : branch->I[j];
-               node->I[k] = node->I[k] > branch->I[k] ? node->I[k] : branch->I[k];
-            }
+   if ((LL = PageAlloc(T, &split->Ref)) == NULL)
+      return false;
+   LL->Leaf = N->Leaf;
+   LE = (struct MapEntry *)(LL + 1);
 
-            free(branch);
-            branch = branch_next;
-         }
-         node->Parent = stack_next;
-         stack_next = node;
+   /*LS1 [Pick first entry for each group]*/
+   /*LPS1-LPS3 [Most extreme pair along any dimension, over the width of all entries]*/
+   for (j = 0, k = RTn; j < RTn; ++j, ++k) {
+      for (low = 0, high = 1, i = 0; i < n; ++i) {
+         if (NL[i].I[j] > NL[low].I[j] && i != high)
+            low = i;
+         if (NL[i].I[k] < NL[high].I[k] && i != low)
+            high = i;
+      }
+      Lcover[j] = NL[0].I[j];
+      Lcover[k] = NL[0].I[k];
+      for (i = 1; i < n; ++i) {
+         if (Lcover[j] > NL[i].I[j])
+            Lcover[j] = NL[i].I[j];
+         if (Lcover[k] < NL[i].I[k])
+            Lcover[k] = NL[i].I[k];
+      }
+      width = (long double)Lcover[k] - Lcover[j];
+      separation = ((long double)NL[low].I[j] - NL[high].I[k]) / (width > 0 ? width : 1);
+      if (separation > sbest && low != high) {
+         seedA = high;
+         seedB = low;
+         sbest = separation;
       }
-      stack = stack_next;
    }
 
-   (*T) = stack;
+   C[0] = NL[seedA];
+   LE[0] = NL[seedB];
+   memcpy(Lcover, NL[seedA].I, sizeof(Lcover));
+   memcpy(LLcover, NL[seedB].I, sizeof(LLcover));
 
-   if ((*T) == NULL) {
-      (*T) = (struct RTNode *)mem_alloc(sizeof(struct RTNode));
-      InitNodes(*T, 1);
-      (*T)->Child = (struct RTNode *)mem_alloc(M * sizeof((*T)->Child[0]));
-      InitNodes((*T)->Child, M);
-   }
+   /*LS2 [Check if done]; LS3 [Select entry to assign] by least enlargement*/
+   for (i = 0; i < n; ++i) {
+      if (i == seedA || i == seedB)
+         continue;
 
-   return true;
-}
+      for (j = 0, k = RTn; j < RTn; ++j, ++k) {
+         Lexpanded[j] = NL[i].I[j] < Lcover[j] ? NL[i].I[j] : Lcover[j];
+         Lexpanded[k] = NL[i].I[k] > Lcover[k] ? NL[i].I[k] : Lcover[k];
+         LLexpanded[j] = NL[i].I[j] < LLcover[j] ? NL[i].I[j] : LLcover[j];
+         LLexpanded[k] = NL[i].I[k] > LLcover[k] ? NL[i].I[k] : LLcover[k];
+      }
 
-/*Initializes an array of struct Nodes*/
-static bool InitNodes(struct RTNode *ptr, RTchildindex size) {
-   RTchildindex i;
+      if (n - (A + B) + A <= PAGE_MIN)
+         toL = true;
+      else if (n - (A + B) + B <= PAGE_MIN)
+         toL = false;
+      else {
+         Larea = Volume(Lcover);
+         LLarea = Volume(LLcover);
+         Lincrease = Volume(Lexpanded) - Larea;
+         LLincrease = Volume(LLexpanded) - LLarea;
+         toL = Lincrease < LLincrease || (Lincrease == LLincrease && (Larea < LLarea || (Larea == LLarea && A < B)));
+      }
 
-   for (i = 0; i < size; ++i) {
-      ptr[i] = EMPTY_NODE;
+      if (toL) {
+         C[A++] = NL[i];
+         memcpy(Lcover, Lexpanded, sizeof(Lcover));
+      } else {
+         LE[B++] = NL[i];
+         memcpy(LLcover, LLexpanded, sizeof(LLcover));
+      }
    }
 
+   N->Count = (uint32_t)A;
+   LL->Count = (uint32_t)B;
+   memcpy(split->I, LLcover, sizeof(split->I));
+   PageUnpin(T, LL, true);
    return true;
 }
 
-/*Frees the children of a Tree*/
-static bool FreeNodes(struct RTNode *T) {
-   if (IS_BRANCH(T)) {
-      RTchildindex i;
-      for (i = 0; i < M && !IS_EMPTY(T->Child[i]); ++i)
-         FreeNodes(T->Child+i);
-
-      free(T->Child);
-      return true;
-   /*Property (5) - Root and Leaf*/
-   } else if (IS_LEAF(T) || ((T->Child && IS_EMPTY(T->Child[0])))) {
-      free(T->Child);
-      return true;
-   }
-
-   fputs("rtree on fire!\n", stderr);
-   return false;
-}
-
-/*Frees a Tree*/
-bool RTFreeTree(RTreePtr *T) {
-   if (!T || !*T)
-      return true;
-
-   if (!FreeNodes(*T))
+/*3.3 Deletion on pages*/
+/*In: Paged Tree, Dead Size, Dead Id*/
+static bool PageDelete(struct RTPaged *T, RTdimension I[], uint64_t Id) {
+   struct {
+      struct PageNode *Node;
+      uint32_t Next; /*one past the entry descended into*/
+      bool Dirty;
+   } path[MAX_HEIGHT];
+   struct PageOrphan *orphan = NULL;
+   struct PageNode *N, *P;
+   struct MapEntry *C;
+   RTdimension cover[RTn*2];
+   size_t depth, d, orphans = 0, capacity = 0;
+   uint64_t page;
+   uint32_t i;
+   bool found = false, ok = true;
+
+   if ((path[0].Node = PagePin(T, T->Header.Root)) == NULL)
       return false;
+   path[0].Next = 0;
+   path[0].Dirty = false;
 
-   free(*T);
-   *T = NULL;
-   return true;
-}
+   /*D1 [Find node containing record]*/
+   /*FL1-FL2 [Search subtrees whose box holds the record, then the leaf]*/
+   for (depth = 1; depth; ) {
+      N = path[depth-1].Node;
+      C = (struct MapEntry *)(N + 1);
+
+      if (N->Leaf) {
+         for (i = 0; i < N->Count && (C[i].Ref != Id || memcmp(C[i].I, I, sizeof(C[i].I))); ++i) ;
+         if (i < N->Count) {
+            /*D2 [Delete record]*/
+            C[i] = C[--N->Count];
+            path[depth-1].Dirty = true;
+            found = true;
+            break;
+         }
+      } else {
+         for (i = path[depth-1].Next; i < N->Count && !Within(I, C[i].I); ++i) ;
+         if (i < N->Count) {
+            path[depth-1].Next = i + 1;
+            if (depth == MAX_HEIGHT || (path[depth].Node = PagePin(T, C[i].Ref)) == NULL) {
+               ok = false;
+               break;
+            }
+            path[depth].Next = 0;
+            path[depth].Dirty = false;
+            ++depth;
+            continue;
+         }
+      }
 
-/*3.1 Searching*/
-/*Algorithm Search*/
-/*In: Parent Node, Search Box  Out: Hit List, Hit Count*/
-bool RTSelectTuple(RTreePtr *T, RTdimension S[], struct RTNodeList **list, size_t *count) {
-   if (!T || !*T) {
-      fputs("RTree cannot be NULL.\n", stderr);
-      return false;
+      PageUnpin(T, N, false);
+      --depth;
    }
 
-   if (!list && !count) {
-      fputs("Must have List and/or Count.\n", stderr);
+   if (!found) {
+      while (depth)
+         PageUnpin(T, path[--depth].Node, false);
       return false;
    }
 
-   return Search(*T, S, list, count);
-}
-
-/*In: Parent Node, Search Box  Out: Hit List, Hit Count*/
-static bool Search(struct RTNode *T, RTdimension S[], struct RTNodeList **list, size_t *count) {
-   struct RTNodeList *curr = NULL;
-   size_t cnt = 0;
-   RTchildindex i = 0;
-
-   if (count) *count = 0;
-
-   /*S1 [Search subtrees]*/
-   if (IS_BRANCH(T)) {
-      for (i = 0; i < M && !IS_EMPTY(T->Child[i]); ++i)
-         if (Overlap(T->Child[i].I, S)) {
-            if (!Search(T->Child+i, S, list, &cnt)) {
-               if (list) *list = NULL;
-               if (count) *count = 0;
-               return false;
-            }
-            if (count) *count += cnt;
+   /*D3 [Propagate changes]*/
+   /*CT3 [Eliminate under-full node]: its entries wait to go back in at its level*/
+   /*CT4 [Adjust covering rectangle]*/
+   for (d = depth - 1; d > 0; --d) {
+      N = path[d].Node;
+      P = path[d-1].Node;
+      C = (struct MapEntry *)(P + 1) + path[d-1].Next - 1;
+
+      if (N->Count < PAGE_MIN) {
+         if (orphans + N->Count > capacity) {
+            capacity = (orphans + N->Count) * 2;
+            orphan = (struct PageOrphan *)mem_realloc(orphan, capacity * sizeof(orphan[0]));
          }
+         for (i = 0; i < N->Count; ++i, ++orphans) {
+            orphan[orphans].E = ((struct MapEntry *)(N + 1))[i];
+            orphan[orphans].Level = T->Header.Height - 1 - d;
+         }
+         PageDrop(T, N, C->Ref);
+         *C = ((struct MapEntry *)(P + 1))[--P->Count];
+         path[d-1].Dirty = true;
+         continue;
+      }
 
-      return true;
+      PageCover(N, cover);
+      if (memcmp(cover, C->I, sizeof(cover))) {
+         memcpy(C->I, cover, sizeof(cover));
+         path[d-1].Dirty = true;
+      }
+      PageUnpin(T, N, path[d].Dirty);
+   }
+   PageUnpin(T, path[0].Node, path[0].Dirty);
 
-   /*S2 [Search leaf node]*/
-   /*Property (5) - Root and Leaf*/
-   } else if (IS_LEAF(T) || ((T->Child) && IS_EMPTY(T->Child[0]))) {
-      for (i = 0; i < M && !IS_EMPTY(T->Child[i]); ++i)
-         if (Overlap(T->Child[i].I, S)) {
-            if (list) {
-               curr = (struct RTNodeList *)mem_alloc(sizeof(struct RTNodeList));
-               memcpy(curr->I, T->Child[i].I, sizeof(curr->I));
-               curr->Tuple = (T->Child+i)->Tuple;
-               curr->Next = *list;
-               *list = curr;
-            }
-            if (count) (*count)++;
-         }
+   /*CT6 [Re-insert orphaned entries]*/
+   for (d = 0; d < orphans; ++d)
+      ok = PageInsert(T, &orphan[d].E, orphan[d].Level) && ok;
+   free(orphan);
 
-      return true;
+   /*D4 [Shorten tree]*/
+   while (ok && T->Header.Height > 1) {
+      if ((N = PagePin(T, T->Header.Root)) == NULL)
+         return false;
+      if (N->Leaf || N->Count != 1) {
+         PageUnpin(T, N, false);
+         break;
+      }
+      page = T->Header.Root;
+      T->Header.Root = ((struct MapEntry *)(N + 1))[0].Ref;
+      --T->Header.Height;
+      PageDrop(T, N, page);
    }
 
-   fputs("rtree on fire!\n", stderr);
-   if (list) *list = NULL;
-   if (count) *count = 0;
-   return false;
+   return ok;
 }
 
 /*3.2 Insertion*/
 /*Algorithm Insert*/
 /*In: Parent Node, Size, Tuple */
 bool RTInsertTuple(RTreePtr *N, RTdimension I[], void *Tuple) {
-   if (!N || !*N) {
+   bool ok;
+
+   if (!N || !*N || !(*N)->Root) {
       fputs("RTree cannot be NULL.\n", stderr);
       return false;
    }
@@ -353,15 +4836,70 @@ bool RTInsertTuple(RTreePtr *N, RTdimension I[], void *Tuple) {
 
    /*TODO Guarantee x1 < x2 && y1 < y2 && ...*/
 
-   return Insert(N, LEVEL_LEAF, I, Tuple, NULL);
+   if ((*N)->Config.Sync == RTSyncLink)
+      return LinkInsert(*N, I, Tuple);
+
+   (*N)->Reinserted = 0;
+   ok = Insert(*N, &(*N)->Root, LEVEL_LEAF, I, Tuple, NULL);
+   Publish(*N);
+   return ok;
+}
+
+/*Inserts many entries in Hilbert order, so each run of them headed to one leaf shares one descent and one AdjustTree*/
+/*In: Parent Node, Entries, Entry Count*/
+bool RTInsertBatch(RTreePtr *T, const struct RTEntry entries[], size_t count) {
+   struct RTNode *E;
+   size_t i, used;
+   bool ok = true;
+
+   if (!T || !*T || !(*T)->Root) {
+      fputs("RTree cannot be NULL.\n", stderr);
+      return false;
+   }
+
+   if (!entries && count) {
+      fputs("Must have Entries.\n", stderr);
+      return false;
+   }
+
+   for (i = 0; i < count; ++i)
+      if (!entries[i].Tuple) {
+         fputs("Size and Tuple cannot be NULL.\n", stderr);
+         return false;
+      }
+
+   if (count == 0)
+      return true;
+
+   E = BatchOrder(*T, entries, count);
+
+   if ((*T)->Config.Sync == RTSyncLink) {
+      for (i = 0; ok && i < count; ++i)
+         ok = LinkInsert(*T, E[i].I, E[i].Tuple);
+      free(E);
+      return ok;
+   }
+
+   for (i = 0; ok && i < count; i += used) {
+      ok = InsertGroup(*T, E + i, count - i, &used);
+      if ((*T)->FreshCount >= BATCH_FRESH)
+         Publish(*T);
+   }
+
+   free(E);
+   if (ok)
+      Publish(*T);
+   return ok;
 }
 
 /*In: Parent Node, Level, [Size, Tuple || TupleNode]*/
-static bool Insert(struct RTNode **N, size_t Level, RTdimension I[], void *Tuple, struct RTNode *TupleNode) {
-   struct RTNode *L = NULL, *LL = NULL, *splitL = NULL, *splitR = NULL, *newRoot = NULL;
+static bool Insert(struct RTree *R, struct RTNode **N, size_t Level, RTdimension I[], void *Tuple, struct RTNode *TupleNode) {
+   struct RTNode *L = NULL, *LL = NULL, *splitR = NULL, E, root[2];
+   struct Path path;
    RTdimension *Size;
    size_t Start;
-   RTchildindex h, i;
+   RTchildindex i = 0;
+   uint64_t hilbert = 0;
 
    Size = I;
    if (TupleNode)
@@ -381,13 +4919,43 @@ static bool Insert(struct RTNode **N, size_t Level, RTdimension I[], void *Tuple
       Level = Start;
 
    /*I1 [Find position for new record]*/
-   if (!ChooseLeaf(*N, Start, Level, Size, &L)) {
+   path.Depth = 1;
+   path.Node[0] = *N;
+   if (R->Config.Insert == RTInsertHilbert) {
+      hilbert = TupleNode ? HilbertLHV(R, TupleNode) : HilbertKey(R, I);
+      if (!HilbertChooseLeaf(R, &path, Start, Level, hilbert)) {
+         *N = NULL;
+         return false;
+      }
+   } else if (!ChooseLeaf(R, &path, Start, Level, Size)) {
       *N = NULL;
       return false;
    }
+   ShadowPath(R, &path);
+   L = path.Node[path.Depth-1];
 
    /*I2 [Add record to leaf node]*/
-   for (i = 0; i < M; ++i)
+   if (R->Config.Insert == RTInsertHilbert) {
+      if (Tuple) {
+         E = EMPTY_NODE;
+         memcpy(E.I, I, sizeof(E.I));
+         E.Tuple = Tuple;
+#ifdef RTREE_LHV
+         E.LHV = hilbert;
+#endif
+      } else
+         E = *TupleNode;
+
+      /*Keep the node in Hilbert order, sharing overflow with a sibling*/
+      if (IS_EMPTY(L->Child[R->Max-1])) {
+         i = HilbertSearch(R, L, hilbert);
+         PlaceEntry(L, i, &E);
+         HomeEntries(R, L->Child, i, i+1);
+      } else if (!HilbertSplit(R, PARENT(&path, path.Depth-1), L, &E, hilbert, &LL)) {
+         *N = NULL;
+         return false;
+      }
+   } else for (i = 0; i < R->Max; ++i)
       if (IS_EMPTY(L->Child[i])) {
          if (Tuple) {
             memcpy(L->Child[i].I, I, sizeof(L->Child[i].I));
@@ -408,71 +4976,198 @@ static bool Insert(struct RTNode **N, size_t Level, RTdimension I[], void *Tuple
          }
 #endif
 
-         /* update the newly added child's parent */
-         L->Child[i].Parent = L;
-
-         /* update the newly added child's children's parent because of memcpy */
-         if (L->Child[i].Child != NULL)
-            for (h = 0; h < M && !IS_EMPTY(L->Child[i].Child[h]); ++h)
-               L->Child[i].Child[h].Parent = L->Child+i;
-
+         SyncNode(L);
+         HomeEntries(R, L->Child, i, i+1);
          break;
       }
 
-   if (i == M) {
-      if (!LinearSplit(L, I, Tuple, TupleNode, &LL)) {
+   if (R->Config.Insert != RTInsertHilbert && i == R->Max) {
+      if (!OverflowTreatment(R, PARENT(&path, path.Depth-1), L, I, Tuple, TupleNode, &LL)) {
          *N = NULL;
          return false;
       }
    }
 
    /*I3 [Propagate changes upward]*/
-   if (!AdjustTree(L, LL, &splitL, &splitR)) {
+   if (!AdjustTree(R, &path, LL, &splitR)) {
       *N = NULL;
       return false;
    }
 
    /*I4 [Grow tree taller]*/
+   /*The root stays where it is and takes its old self and the split node as children*/
    if (splitR) {
-      newRoot = (struct RTNode *)mem_alloc(sizeof(struct RTNode));
-      InitNodes(newRoot, 1);
-      newRoot->Child = (struct RTNode *)mem_alloc(M * sizeof(struct RTNode));
-      InitNodes(newRoot->Child, M);
+      root[0] = **N;
+      root[1] = *splitR;
+      free(splitR);
 
-      if (!Insert(&newRoot, LEVEL_TOP, NULL, NULL, splitL) || !Insert(&newRoot, LEVEL_TOP, NULL, NULL, splitR)) {
-         *N = NULL;
+      (*N)->Child = NewChildren(R);
+      FillNode(*N, root, 2);
+      HomeEntries(R, (*N)->Child, 0, 2);
+   }
+
+   /*Entries forced out by an overflow go back once the tree is whole again*/
+   if (N == &R->Root && R->Pending)
+      return ReinsertPending(R);
+
+   return true;
+}
+
+/*Copies a batch in Hilbert order, on the tree's own curve under Hilbert insertion or else on one spanning the batch*/
+/*In: Tree, Entries, Entry Count  Out: Ordered Entries to free*/
+static struct RTNode *BatchOrder(struct RTree *R, const struct RTEntry entries[], size_t count) {
+   struct RTree keyer;
+   struct RTNode *E;
+   long double *key;
+   size_t i;
+   RTdimensionindex j, k;
+
+   memset(&keyer, 0, sizeof(keyer));
+   keyer.Config.Threads = R->Config.Threads;
+   memcpy(keyer.Config.Bounds, entries[0].I, sizeof(keyer.Config.Bounds));
+   E = (struct RTNode *)mem_alloc(count * sizeof(E[0]));
+   for (i = 0; i < count; ++i) {
+      for (j = 0, k = RTn; j < RTn; ++j, ++k) {
+         if (keyer.Config.Bounds[j] > entries[i].I[j])
+            keyer.Config.Bounds[j] = entries[i].I[j];
+         if (keyer.Config.Bounds[k] < entries[i].I[k])
+            keyer.Config.Bounds[k] = entries[i].I[k];
+      }
+      memcpy(E[i].I, entries[i].I, sizeof(E[i].I));
+      E[i].Tuple = entries[i].Tuple;
+   }
+   if (R->Config.Insert == RTInsertHilbert)
+      memcpy(keyer.Config.Bounds, R->Config.Bounds, sizeof(keyer.Config.Bounds));
+
+   key = (long double *)mem_realloc(NULL, count * sizeof(key[0]));
+   LoadKeysRun(&keyer, E, key, count, RTn);
+   LoadSortRun(&keyer, &E, &key, count);
+#ifdef RTREE_LHV
+   if (R->Config.Insert == RTInsertHilbert)
+      for (i = 0; i < count; ++i)
+         E[i].LHV = (uint64_t)key[i];
+#endif
+   free(key);
+   return E;
+}
+
+/*Inserts the first entries of an ordered batch that ChooseLeaf sends to the same leaf, while it has room*/
+/*Entries within the leaf's box, or under Hilbert insertion with values up to its LHV, take the same path*/
+/*In: Tree, Entries, Entry Count  Out: Entries inserted*/
+static bool InsertGroup(struct RTree *R, struct RTNode E[], size_t n, size_t *used) {
+   struct RTNode *L, *splitR = NULL;
+   struct Path path;
+   size_t Start;
+   RTchildindex count, pos;
+   uint64_t h = 0, lhv = 0;
+   bool hilbert = R->Config.Insert == RTInsertHilbert, last = false;
+
+   R->Reinserted = 0;
+   *used = 1;
+   for (Start = 0, L = R->Root; L->Child; ++Start, L = L->Child) ;
+
+   /*I1 [Find position for new record]*/
+   path.Depth = 1;
+   path.Node[0] = R->Root;
+   if (hilbert) {
+      h = HilbertLHV(R, E);
+      last = h > HilbertLHV(R, R->Root);
+      if (!HilbertChooseLeaf(R, &path, Start, LEVEL_LEAF, h)) {
+         R->Root = NULL;
          return false;
       }
+   } else if (!ChooseLeaf(R, &path, Start, LEVEL_LEAF, E[0].I)) {
+      R->Root = NULL;
+      return false;
+   }
 
-      free(splitL);
-      free(splitR);
-      *N = newRoot;
-      return true;
+   /*A full leaf splits through Insert*/
+   L = path.Node[path.Depth-1];
+   if (!IS_EMPTY(L->Child[R->Max-1]))
+      return Insert(R, &R->Root, LEVEL_LEAF, E[0].I, E[0].Tuple, NULL);
+
+   /*Values beyond the last LHV of the tree keep taking the last child down*/
+   if (hilbert)
+      lhv = HilbertLHV(R, L);
+   ShadowPath(R, &path);
+   L = path.Node[path.Depth-1];
+
+   /*I2 [Add record to leaf node]*/
+   for (count = CountChildren(L), *used = 0; *used < n && count < R->Max; ++*used, ++count) {
+      if (*used && path.Depth > 1) {
+         if (hilbert ? !last && HilbertLHV(R, E + *used) > lhv : !Within(E[*used].I, L->I))
+            break;
+      }
+
+      if (hilbert) {
+         pos = HilbertSearch(R, L, HilbertLHV(R, E + *used));
+         PlaceEntry(L, pos, E + *used);
+      } else {
+         pos = count;
+         L->Child[pos] = E[*used];
+      }
+      HomeEntries(R, L->Child, pos, pos+1);
+   }
+   SyncNode(L);
+
+   /*I3 [Propagate changes upward]*/
+   if (!AdjustTree(R, &path, NULL, &splitR)) {
+      R->Root = NULL;
+      return false;
    }
 
-   *N = splitL;
    return true;
 }
 
 /*Algorithm ChooseLeaf*/
 /*CL1 [Initialize]*/
-/*In: Parent Node, Parent Level, Leaf Level, Tuple Size  Out: Chosen Leaf*/
-static bool ChooseLeaf(struct RTNode *N, size_t Start, size_t Stop, RTdimension *I, struct RTNode **leaf) {
-   RTchildindex i = 0;
-   RTdimensionindex j = 0, k = 0;
-   long double area = 0, increase = 0, min = 0, minarea = 0;
-   RTdimension expanded[RTn*2];
-   struct RTNode *F = NULL;
+/*In: Path to Parent Node, Parent Level, Leaf Level, Tuple Size  Out: Path to Chosen Leaf*/
+static bool ChooseLeaf(const struct RTree *R, struct Path *path, size_t Start, size_t Stop, RTdimension *I) {
+   struct RTNode *N = path->Node[path->Depth-1];
 
    /*Property (5) - Root and Leaf*/
    /*CL2 [Leaf check]*/
    if (Start == Stop) {
-      *leaf = N;
       return true;
 
    /*CL3 [Choose subtree]*/
-   } else if (IS_BRANCH(N)) {
-      min = N->I[RTn];
+   } else if (IS_BRANCH(N) && path->Depth < MAX_HEIGHT) {
+      /*CL4 [Descend until a leaf is reached]*/
+      path->Node[path->Depth++] = ChooseSubtree(R, N, I, Start-1 == Stop);
+      return ChooseLeaf(R, path, Start-1, Stop, I);
+   }
+
+   fputs("rtree on fire!\n", stderr);
+   return false;
+}
+
+/*CL3 [Choose subtree]*/
+/*In: Branch Node, Tuple Size, Whether its Children are the Target Level  Out: Chosen Child*/
+static struct RTNode *ChooseSubtree(const struct RTree *R, struct RTNode *N, RTdimension *I, bool last) {
+   RTchildindex i = 0;
+   RTdimensionindex j = 0, k = 0;
+   long double area = 0, increase = 0, min = 0, minarea = 0;
+   RTdimension expanded[RTn*2];
+   struct RTNode *F = NULL;
+   uint64_t mask[MASK_WORDS];
+
+   /*Children already covering the entry need no enlargement; take the smallest*/
+   ContainMask(N, I, mask);
+   if ((i = NextChild(mask)) < M) {
+      F = N->Child+i;
+      minarea = Volume(F->I);
+      while ((i = NextChild(mask)) < M)
+         if ((area = Volume(N->Child[i].I)) < minarea) {
+            minarea = area;
+            F = N->Child+i;
+         }
+
+   /*R*-tree: the node receiving the entry is the one least overlapping its siblings*/
+   } else if (R->Config.Insert == RTInsertRStar && last) {
+      F = RStarChooseSubtree(N, I);
+
+   } else {
+      min = LDBL_MAX;
       minarea = Volume(N->Child[0].I);
       F = N->Child;
 
@@ -490,181 +5185,499 @@ static bool ChooseLeaf(struct RTNode *N, size_t Start, size_t Stop, RTdimension
             F = N->Child+i;
          }
       }
-
-      /*CL4 [Descend until a leaf is reached]*/
-      return ChooseLeaf(F, Start-1, Stop, I, leaf);
    }
 
-   fputs("rtree on fire!\n", stderr);
-   *leaf = NULL;
-   return false;
+   return F;
 }
 
-/*Algorithm AdjustTree*/
-/*AT1 [Initialize]*/
-/*In: Start Node, Split Node  Out: Root Node, Split Node*/
-static bool AdjustTree(struct RTNode *N, struct RTNode *NN, struct RTNode **root, struct RTNode **split) {
-   struct RTNode *P = NULL, *LS = NULL;
-   RTchildindex h, i;
-   RTdimensionindex j, k;
+/*Beckmann et al.: The R*-tree, Proc. 1990 ACM SIGMOD, pp. 322-331*/
+/*Algorithm ChooseSubtree, child pointers point to the target level*/
+/*In: Branch Node, Tuple Size  Out: Chosen Child*/
+static struct RTNode *RStarChooseSubtree(struct RTNode *N, RTdimension *I) {
+   RTchildindex count = CountChildren(N), order[M], best = 0, c, h, i;
+   RTdimensionindex j = 0, k = 0;
+   long double area[M], increase[M], overlap = 0, min = LDBL_MAX;
+   RTdimension expanded[RTn*2];
 
-   /*AT2 [Check if done]*/
-   if (N == NULL) {
-      *split = NN;
-      return true;
+   for (i = 0; i < count; ++i) {
+      area[i] = Volume(N->Child[i].I);
+      for (j = 0, k = RTn; j < RTn; ++j, ++k) {
+         expanded[j] = ( I[j] < N->Child[i].I[j] ) ? I[j] : N->Child[i].I[j];
+         expanded[k] = ( I[k] > N->Child[i].I[k] ) ? I[k] : N->Child[i].I[k];
+      }
+      increase[i] = Volume(expanded) - area[i];
+
+      /*Order by least area enlargement, then least area*/
+      for (h = i; h > 0 && (increase[order[h-1]] > increase[i] || (increase[order[h-1]] == increase[i] && area[order[h-1]] > area[i])); --h)
+         order[h] = order[h-1];
+      order[h] = i;
    }
 
-   /*AT3 [Adjust covering rectangle in parent entry]*/
-   P = N->Parent;
-   memcpy(N->I, N->Child[0].I, sizeof(N->I));
-   for (i = 0; i < M && !IS_EMPTY(N->Child[i]); ++i)
+   /*Only the least enlarged children are worth the quadratic overlap test*/
+   for (c = 0; c < count && c < RSTAR_CANDIDATES; ++c) {
+      i = order[c];
       for (j = 0, k = RTn; j < RTn; ++j, ++k) {
-         if (N->I[j] > N->Child[i].I[j])
-            N->I[j] = N->Child[i].I[j];
-         if (N->I[k] < N->Child[i].I[k])
-            N->I[k] = N->Child[i].I[k];
+         expanded[j] = ( I[j] < N->Child[i].I[j] ) ? I[j] : N->Child[i].I[j];
+         expanded[k] = ( I[k] > N->Child[i].I[k] ) ? I[k] : N->Child[i].I[k];
+      }
+
+      for (overlap = 0, h = 0; h < count; ++h)
+         if (h != i)
+            overlap += Intersection(expanded, N->Child[h].I) - Intersection(N->Child[i].I, N->Child[h].I);
+
+      /*Ties keep the earlier candidate, which needs less enlargement*/
+      if (overlap < min) {
+         min = overlap;
+         best = i;
+         if (min == 0)
+            break;
       }
+   }
 
-   /*AT4 [Propagate node split upward]*/
-   if (P && NN) {
-      for (i = 0; i < M; ++i)
-         if (IS_EMPTY(P->Child[i])) {
-            memcpy(P->Child+i, NN, sizeof(P->Child[i]));
+   return N->Child+best;
+}
 
-            /* update the newly added child's parent */
-            P->Child[i].Parent = P;
+/*Algorithm AdjustTree*/
+/*AT1 [Initialize]*/
+/*In: Path to Start Node, Split Node  Out: Split of the Root*/
+static bool AdjustTree(struct RTree *R, struct Path *path, struct RTNode *NN, struct RTNode **split) {
+   struct RTNode *N = NULL, *P = NULL, *LS = NULL;
+   RTchildindex i;
+   RTdimensionindex j, k;
+   size_t d;
+   uint64_t hilbert;
 
-            /* update the newly added child's children's parent because of memcpy */
-            if (P->Child[i].Child != NULL)
-               for (h = 0; h < M && !IS_EMPTY(P->Child[i].Child[h]); ++h)
-                  P->Child[i].Child[h].Parent = P->Child+i;
+   /*AT2 [Check if done]*/
+   for (d = path->Depth; d > 0; --d) {
+      N = path->Node[d-1];
+      P = PARENT(path, d-1);
 
+      /*AT3 [Adjust covering rectangle in parent entry]*/
+      memcpy(N->I, N->Child[0].I, sizeof(N->I));
+      for (i = 0; i < M && !IS_EMPTY(N->Child[i]); ++i)
+         for (j = 0, k = RTn; j < RTn; ++j, ++k) {
+            if (N->I[j] > N->Child[i].I[j])
+               N->I[j] = N->Child[i].I[j];
+            if (N->I[k] < N->Child[i].I[k])
+               N->I[k] = N->Child[i].I[k];
+         }
+      SyncNode(N);
+
+      /*AT4 [Propagate node split upward]*/
+      if (P && NN && R->Config.Insert == RTInsertHilbert) {
+         hilbert = HilbertLHV(R, NN);
+         if (IS_EMPTY(P->Child[R->Max-1])) {
+            i = HilbertSearch(R, P, hilbert);
+            PlaceEntry(P, i, NN);
+            HomeEntries(R, P->Child, i, i+1);
             free(NN);
             NN = NULL;
-            break;
+         } else {
+            if (!HilbertSplit(R, PARENT(path, d-2), P, NN, hilbert, &LS)) {
+               *split = NULL;
+               return false;
+            }
+            free(NN);
+            NN = LS;
          }
+      } else if (P && NN) {
+         for (i = 0; i < R->Max; ++i)
+            if (IS_EMPTY(P->Child[i])) {
+               memcpy(P->Child+i, NN, sizeof(P->Child[i]));
+               SyncNode(P);
+               HomeEntries(R, P->Child, i, i+1);
+               free(NN);
+               NN = NULL;
+               break;
+            }
 
-      if (i == M) {
-         if (!LinearSplit(P, NULL, NULL, NN, &LS)) {
-            *root = NULL;
-            *split = NULL;
-            return false;
+         if (i == R->Max) {
+            if (!OverflowTreatment(R, PARENT(path, d-2), P, NULL, NULL, NN, &LS)) {
+               *split = NULL;
+               return false;
+            }
+            free(NN);
+            NN = LS;
          }
-         free(NN);
-         NN = LS;
       }
-   } else if (P == NULL && NN) {
-      *root = N;
-      *split = NN;
-      return true;
+
+      /*AT5 [Move up to next level]*/
    }
 
-   /*AT5 [Move up to next level]*/
-   *root = N;
-   return AdjustTree(P, NN, root, split);
+   *split = NN;
+   return true;
 }
 
 /*In: Parent Node, Dead Size, Dead Tuple */
 bool RTDeleteTuple(RTreePtr *T, RTdimension I[], void *Tuple) {
+   bool ok;
+
    if (I == NULL || Tuple == NULL) {
       fputs("Must have Size and Tuple.\n", stderr);
       return false;
    }
 
-   return Delete(T, I, Tuple);
+   if (!T || !*T || !(*T)->Root) {
+      fputs("RTree cannot be NULL.\n", stderr);
+      return false;
+   }
+
+   if ((*T)->Config.Sync == RTSyncLink)
+      return LinkDelete(*T, I, Tuple);
+
+   ok = Delete(*T, I, Tuple);
+   Publish(*T);
+   return ok;
+}
+
+/*Deletes many entries in Hilbert order, so each run of them in one leaf shares one FindLeaf and one CondenseTree*/
+/*Entries not in the tree are passed over*/
+/*In: Parent Node, Entries, Entry Count  Out: Deleted Count*/
+bool RTDeleteBatch(RTreePtr *T, const struct RTEntry entries[], size_t count, size_t *deleted) {
+   struct RTNode *E;
+   size_t i, used, dead = 0;
+   bool ok = true;
+
+   if (deleted) *deleted = 0;
+
+   if (!T || !*T || !(*T)->Root) {
+      fputs("RTree cannot be NULL.\n", stderr);
+      return false;
+   }
+
+   if (!entries && count) {
+      fputs("Must have Entries.\n", stderr);
+      return false;
+   }
+
+   for (i = 0; i < count; ++i)
+      if (!entries[i].Tuple) {
+         fputs("Must have Size and Tuple.\n", stderr);
+         return false;
+      }
+
+   if (count == 0)
+      return true;
+
+   E = BatchOrder(*T, entries, count);
+
+   if ((*T)->Config.Sync == RTSyncLink) {
+      for (i = 0; i < count; ++i)
+         dead += LinkDelete(*T, E[i].I, E[i].Tuple);
+   } else
+      for (i = 0; ok && i < count; i += used) {
+         ok = DeleteGroup(*T, E + i, count - i, &used, &dead);
+         if ((*T)->FreshCount >= BATCH_FRESH)
+            Publish(*T);
+      }
+
+   free(E);
+   if (ok && (*T)->Config.Sync != RTSyncLink)
+      Publish(*T);
+   if (deleted) *deleted = dead;
+   return ok;
 }
 
 /*3.3 Deletion*/
 /*Algorithm Delete*/
 /*In: Parent Node, Dead Size, Dead Tuple */
-static bool Delete(struct RTNode **T, RTdimension I[], void *Tuple) {
-   struct RTNode *L = NULL, *newRoot = NULL;
-   RTchildindex i, pos = 0;
+static bool Delete(struct RTree *R, RTdimension I[], void *Tuple) {
+   struct RTNode **T = &R->Root, *L = NULL;
+   struct Path path;
+   RTchildindex pos = 0;
+
+   R->Reinserted = 0;
 
    /*D1 [Find node containing record]*/
-   if (!FindLeaf(*T, I, Tuple, &L, &pos)) {
+   if (!HomeLeaf(R, I, Tuple, &path, &pos)) {
       *T = NULL;
       return false;
    }
 
    /*If the tuple wasn't found*/
-   if (pos == M || L == NULL)
+   if (pos == M)
       return false;
 
    /*D2 [Delete record]*/
+   ShadowPath(R, &path);
+   L = path.Node[path.Depth-1];
    memmove(L->Child+pos, L->Child+pos+1, (M - 1 - pos) * sizeof(L->Child[pos]));
    InitNodes(L->Child+M-1, 1);
+   SyncNode(L);
+   if (R->Config.Index)
+      HomeDrop(&R->Tuples, Tuple, L->Child);
 
    /*D3 [Propagate changes]*/
-   if (!CondenseTree(L, T)) {
+   if (!CondenseTree(R, &path)) {
       *T = NULL;
       return false;
    }
 
-   /*Property (5) - Root and Leaf*/
-   /*D4 [Shorten tree]*/
-   if (IS_EMPTY((*T)->Child[1]) && IS_BRANCH(*T)) {
-      newRoot = (struct RTNode *)mem_alloc(sizeof(struct RTNode));
-      memcpy(newRoot, (*T)->Child+0, sizeof(*newRoot));
+   ShortenTree(R);
+   return true;
+}
+
+/*Property (5) - Root and Leaf*/
+/*D4 [Shorten tree]*/
+/*The root keeps its place and takes over its only child*/
+static void ShortenTree(struct RTree *R) {
+   struct RTNode *old;
+
+   if (IS_EMPTY(R->Root->Child[1]) && IS_BRANCH(R->Root)) {
+      old = R->Root->Child;
+      *R->Root = old[0];
+      DropChildren(R, old);
+      if (R->Config.Index)
+         HomeDrop(&R->Arrays, R->Root->Child, NULL);
+   }
+}
+
+/*Deletes the first entries of an ordered batch that lie in the same leaf, with one FindLeaf and one CondenseTree*/
+/*In: Tree, Entries, Entry Count  Out: Entries taken from the batch, Deleted Count increased*/
+static bool DeleteGroup(struct RTree *R, struct RTNode E[], size_t n, size_t *used, size_t *deleted) {
+   struct RTNode *L;
+   struct Path path;
+   RTchildindex pos = 0, count;
+
+   R->Reinserted = 0;
+   *used = 1;
+
+   /*D1 [Find node containing record]*/
+   if (!HomeLeaf(R, E[0].I, E[0].Tuple, &path, &pos)) {
+      R->Root = NULL;
+      return false;
+   }
 
-      /* update the newly added child's children's parent because of memcpy */
-      for (i = 0; i < M && !IS_EMPTY(newRoot->Child[i]); ++i)
-         newRoot->Child[i].Parent = newRoot;
+   /*If the tuple wasn't found*/
+   if (pos == M)
+      return true;
+
+   /*D2 [Delete record], with the entries after it found in the same leaf*/
+   ShadowPath(R, &path);
+   L = path.Node[path.Depth-1];
+   for (count = CountChildren(L), *used = 0; *used < n; ++*used, ++*deleted) {
+      if (*used)
+         for (pos = 0; pos < count && (L->Child[pos].Tuple != E[*used].Tuple || memcmp(L->Child[pos].I, E[*used].I, sizeof(E[0].I))); ++pos) ;
+      if (pos == count)
+         break;
+      memmove(L->Child+pos, L->Child+pos+1, (count - 1 - pos) * sizeof(L->Child[pos]));
+      InitNodes(L->Child + --count, 1);
+      if (R->Config.Index)
+         HomeDrop(&R->Tuples, E[*used].Tuple, L->Child);
+   }
+   SyncNode(L);
 
-      free((*T)->Child);
-      free(*T);
-      newRoot->Parent = NULL;
-      *T = newRoot;
+   /*D3 [Propagate changes]*/
+   if (!CondenseTree(R, &path)) {
+      R->Root = NULL;
+      return false;
    }
 
+   ShortenTree(R);
    return true;
 }
 
 /*Algorithm FindLeaf*/
-/*In: Parent Node, Size, Tuple  Out: Leaf Node, Position*/
-static bool FindLeaf(struct RTNode *T, RTdimension I[], void *Tuple, struct RTNode **L, RTchildindex *position) {
+/*In: Parent Node, Size, Tuple  Out: Path to Leaf Node, Position*/
+static bool FindLeaf(struct RTNode *T, RTdimension I[], void *Tuple, struct Path *leaf, RTchildindex *position) {
+   struct SearchPath path;
    RTchildindex i;
+   size_t d;
 
-   *L = NULL;
+   leaf->Depth = 0;
    *position = M;
 
-   /*FL1 [Search subtrees]*/
-   if (IS_BRANCH(T)) {
-      for (i = 0; i < M && !IS_EMPTY(T->Child[i]); ++i)
-         if (Overlap(T->Child[i].I, I)) {
-            if (!FindLeaf(T->Child+i, I, Tuple, L, position)) {
-               *position = M;
-               *L = NULL;
-               return false;
-            }
-            if (*position < M) {
+   path.Depth = 1;
+   path.Stack[0].Node = T;
+   ContainMask(T, I, path.Stack[0].Mask);
+
+   while (path.Depth) {
+      T = path.Stack[path.Depth-1].Node;
+
+      /*FL2 [Search leaf node for record]*/
+      /*Property (5) - Root and Leaf*/
+      if (IS_LEAF(T) || IS_EMPTY(T->Child[0])) {
+         for (i = 0; i < M && !IS_EMPTY(T->Child[i]); ++i)
+            if (T->Child[i].Tuple == Tuple && !memcmp(T->Child[i].I, I, sizeof(T->Child[i].I))) {
+               for (d = 0; d < path.Depth; ++d)
+                  leaf->Node[d] = path.Stack[d].Node;
+               leaf->Depth = path.Depth;
+               *position = i;
                return true;
             }
+         --path.Depth;
+         continue;
+      }
+
+      /*FL1 [Search subtrees]*/
+      if ((i = NextChild(path.Stack[path.Depth-1].Mask)) < M) {
+         if (path.Depth == MAX_HEIGHT || !IS_BRANCH(T)) {
+            fputs("rtree on fire!\n", stderr);
+            return false;
          }
-      return true;
+         path.Stack[path.Depth].Node = T->Child+i;
+         ContainMask(T->Child+i, I, path.Stack[path.Depth].Mask);
+         ++path.Depth;
+      } else
+         --path.Depth;
+   }
+
+   return true;
+}
+
+/*Back-index from each Tuple to its leaf, so deletes and updates skip FindLeaf*/
+/*The table is only a hint: HomeLeaf climbs it to the root's child array and then walks back down*/
+/*through the tree's own pointers, so a home left stale by some move costs a FindLeaf, never a wrong answer*/
+
+/*Algorithm FindLeaf, starting from the homes of the entry and of the child arrays above it*/
+/*In: Tree, Size, Tuple  Out: Path to Leaf Node, Position*/
+static bool HomeLeaf(struct RTree *R, RTdimension I[], void *Tuple, struct Path *leaf, RTchildindex *position) {
+   struct RTNode *array[MAX_HEIGHT], *N;
+   RTchildindex slot[MAX_HEIGHT], i;
+   const struct Home *H;
+   size_t d, h;
+
+   if (!R->Config.Index || (H = HomeFind(&R->Tuples, Tuple)) == NULL)
+      return FindLeaf(R->Root, I, Tuple, leaf, position);
+
+   /*Leaf first, up to the root's child array*/
+   for (h = 0; H && h < MAX_HEIGHT; ++h) {
+      array[h] = H->Child;
+      slot[h] = H->Slot;
+      if (H->Child == R->Root->Child)
+         break;
+      H = HomeFind(&R->Arrays, H->Child);
+   }
+
+   if (h == MAX_HEIGHT || !H)
+      return FindLeaf(R->Root, I, Tuple, leaf, position);
+
+   /*Down again, each node holding the next array*/
+   leaf->Node[0] = R->Root;
+   for (d = 1; d <= h; ++d) {
+      N = leaf->Node[d-1];
+      i = slot[h-d+1];
+      if (i >= M || N->Child[i].Child != array[h-d])
+         for (i = 0; i < M && !IS_EMPTY(N->Child[i]) && N->Child[i].Child != array[h-d]; ++i) ;
+      if (i == M || IS_EMPTY(N->Child[i]))
+         return FindLeaf(R->Root, I, Tuple, leaf, position);
+      leaf->Node[d] = N->Child+i;
+   }
+   leaf->Depth = h + 1;
 
    /*FL2 [Search leaf node for record]*/
-   /*Property (5) - Root and Leaf*/
-   } else if (IS_LEAF(T) || ((T->Child) && IS_EMPTY(T->Child[0]))) {
-      for (i = 0; i < M && !IS_EMPTY(T->Child[i]); ++i)
-         if (T->Child[i].Tuple == Tuple && !memcmp(T->Child[i].I, I, sizeof(T->Child[i].I))) {
-            *L = T;
-            *position = i;
-            return true;
+   N = leaf->Node[h];
+   i = slot[0];
+   if (i >= M || N->Child[i].Tuple != Tuple || memcmp(N->Child[i].I, I, sizeof(N->Child[i].I)))
+      for (i = 0; i < M && !IS_EMPTY(N->Child[i]) && (N->Child[i].Tuple != Tuple || memcmp(N->Child[i].I, I, sizeof(N->Child[i].I))); ++i) ;
+   if (i == M || IS_EMPTY(N->Child[i]))
+      return FindLeaf(R->Root, I, Tuple, leaf, position);
+
+   *position = i;
+   return true;
+}
+
+#define HOME_HASH(X, key) ((size_t)(((uint64_t)(uintptr_t)(key) * 0x9E3779B97F4A7C15u) >> 24) & ((X)->Size - 1))
+
+/*Returns the slot holding the key, or the free slot ending its probe*/
+static size_t HomeProbe(const struct HomeTable *X, const void *key) {
+   size_t i;
+
+   for (i = HOME_HASH(X, key); X->Slot[i].Key && X->Slot[i].Key != key; i = (i + 1) & (X->Size - 1)) ;
+   return i;
+}
+
+/*Returns the home of a key, or NULL*/
+static struct Home *HomeFind(const struct HomeTable *X, const void *key) {
+   size_t i;
+
+   if (X->Count == 0)
+      return NULL;
+
+   i = HomeProbe(X, key);
+   return X->Slot[i].Key ? X->Slot+i : NULL;
+}
+
+/*Sets the home of a key, doubling the table once it is half full*/
+static void HomeSet(struct HomeTable *X, const void *key, struct RTNode *Child, RTchildindex slot) {
+   struct Home *old;
+   size_t i, n;
+
+   if (2 * (X->Count + 1) > X->Size) {
+      old = X->Slot;
+      n = X->Size;
+      X->Size = n ? 2 * n : 64;
+      X->Slot = (struct Home *)mem_alloc(X->Size * sizeof(X->Slot[0]));
+      for (i = 0; i < n; ++i)
+         if (old[i].Key)
+            X->Slot[HomeProbe(X, old[i].Key)] = old[i];
+      free(old);
+   }
+
+   i = HomeProbe(X, key);
+   if (!X->Slot[i].Key)
+      ++X->Count;
+   X->Slot[i].Key = key;
+   X->Slot[i].Child = Child;
+   X->Slot[i].Slot = slot;
+}
+
+/*Removes the home of a key, if it is in the child array given or that is NULL*/
+static void HomeDrop(struct HomeTable *X, const void *key, const struct RTNode *Child) {
+   size_t i, j, h;
+
+   if (X->Count == 0)
+      return;
+
+   i = HomeProbe(X, key);
+   if (!X->Slot[i].Key || (Child && X->Slot[i].Child != Child))
+      return;
+
+   /*Later homes of the probe move back into the gap, so lookups need no markers for removed ones*/
+   for (j = i; ; ) {
+      X->Slot[i].Key = NULL;
+      do {
+         j = (j + 1) & (X->Size - 1);
+         if (!X->Slot[j].Key) {
+            --X->Count;
+            return;
          }
-      return true;
+         h = HOME_HASH(X, X->Slot[j].Key);
+      } while (i <= j ? i < h && h <= j : i < h || h <= j);
+      X->Slot[i] = X->Slot[j];
+      i = j;
    }
+}
 
-   fputs("rtree on fire!\n", stderr);
-   *L = NULL;
-   *position = M;
-   return false;
+/*Records that entries of a child array were put in their slots*/
+/*In: Tree, Child Array, First Slot, Slot past the Last*/
+static void HomeEntries(struct RTree *R, struct RTNode *Child, RTchildindex from, RTchildindex to) {
+   RTchildindex i;
+
+   if (!R->Config.Index)
+      return;
+
+   for (i = from; i < to && i < M && !IS_EMPTY(Child[i]); ++i)
+      if (Child[i].Child)
+         HomeSet(&R->Arrays, Child[i].Child, Child, i);
+      else
+         HomeSet(&R->Tuples, Child[i].Tuple, Child, i);
+}
+
+/*Records the homes of every entry below a node*/
+static void HomeTree(struct RTree *R, struct RTNode *N) {
+   RTchildindex i;
+
+   HomeEntries(R, N->Child, 0, M);
+   if (IS_BRANCH(N))
+      for (i = 0; i < M && !IS_EMPTY(N->Child[i]); ++i)
+         HomeTree(R, N->Child+i);
 }
 
 /*Algorithm CondenseTree*/
 /*CT1 [Initialize]*/
-/*In: Shrunk Node  Out: root*/
-static bool CondenseTree(struct RTNode *N, struct RTNode **root) {
+/*In: Path to Shrunk Node*/
+static bool CondenseTree(struct RTree *R, struct Path *path) {
    struct CTNodeList
    {
       int level;
@@ -673,20 +5686,21 @@ static bool CondenseTree(struct RTNode *N, struct RTNode **root) {
    };
 
    struct CTNodeList *Q = NULL, *ptr = NULL, *next = NULL;
-   struct RTNode *P = NULL;
-   RTchildindex g = 0, h = 0, i = 0;
+   struct RTNode *N = NULL, *P = NULL;
+   RTchildindex i = 0;
    RTdimensionindex j = 0, k = 0;
-   size_t level = 1;
+   size_t d, level = 1;
 
    /*CT2 [Find parent entry]*/
-   while (N->Parent) {
-      P = N->Parent;
+   for (d = path->Depth - 1; d > 0; --d) {
+      N = path->Node[d];
+      P = path->Node[d-1];
 
       /*CT3 [Eliminate under-full node]*/
-      for (i = 0; i < m && N->Child[i].Parent; ++i) ;
+      for (i = 0; i < R->Min && !IS_EMPTY(N->Child[i]); ++i) ;
 
-      if (i < m) {
-         for (i = 0; i < m && !IS_EMPTY(N->Child[i]); ++i) {
+      if (i < R->Min) {
+         for (i = 0; i < R->Min && !IS_EMPTY(N->Child[i]); ++i) {
             ptr = (struct CTNodeList *)mem_alloc(sizeof(struct CTNodeList));
             ptr->Node = (struct RTNode *)mem_alloc(sizeof(struct RTNode));
             ptr->level = level;
@@ -695,26 +5709,19 @@ static bool CondenseTree(struct RTNode *N, struct RTNode **root) {
             Q = ptr;
          }
 
-         for (i = 0; i < M && !IS_EMPTY(P->Child[i]); ++i)
-            if (P->Child+i == N)
-               break;
+         i = N - P->Child;
 
 #ifdef RTREE_DEBUG
-         if (i == M) {
+         if (i >= M) {
             fputs("rtree on fire!\n", stderr);
-            if (root) *root = NULL;
             return false;
          }
 #endif
 
-         free(P->Child[i].Child);
+         DropChildren(R, N->Child);
          memmove(P->Child+i, P->Child+i+1, (M - 1 - i) * sizeof(P->Child[i]));
          InitNodes(P->Child+M-1, 1);
-
-         /* update the children's children's parent because of memmove */
-         for (g = 0; g < M && !IS_EMPTY(P->Child[g]); ++g)
-            for (h = 0; h < M && !IS_EMPTY(P->Child[g].Child[h]); ++h)
-               P->Child[g].Child[h].Parent = P->Child+g;
+         SyncNode(P);
 
       /*CT4 [Adjust covering rectangle]*/
       } else {
@@ -726,19 +5733,21 @@ static bool CondenseTree(struct RTNode *N, struct RTNode **root) {
                if (N->I[k] < N->Child[i].I[k])
                   N->I[k] = N->Child[i].I[k];
             }
+         SyncNode(N);
       }
 
       /*CT5 [Move up one level in tree]*/
-      N = P;
       ++level;
    }
+   SyncNode(path->Node[0]);
 
    /*CT6 [Re-insert orphaned entries]*/
+   /*Inserting through the tree lets forced reinsertion finish*/
    for ( ; Q != NULL; Q = next) {
 #ifdef RTREE_DEBUG
       if (IS_TUPLE(Q->Node) || IS_LEAF(Q->Node) || IS_BRANCH(Q->Node)) {
 #endif
-         if (!Insert(&N, Q->level, NULL, NULL, Q->Node)) {
+         if (!Insert(R, &R->Root, Q->level, NULL, NULL, Q->Node)) {
             for ( ; Q != NULL; Q = next) {
                next = Q->Next;
                free(Q->Node);
@@ -749,7 +5758,6 @@ static bool CondenseTree(struct RTNode *N, struct RTNode **root) {
 #ifdef RTREE_DEBUG
       } else {
          fputs("rtree on fire!\n", stderr);
-         if (root) *root = NULL;
          return false;
       }
 #endif
@@ -759,49 +5767,22 @@ static bool CondenseTree(struct RTNode *N, struct RTNode **root) {
       free(Q);
    }
 
-   if (root) *root = N;
    return true;
 }
 
 /*3.5.3 A Linear-Cost Algorithm*/
 /*Algorithm LinearSplit*/
-/*In: Full Node, [Extra Size, Extra Tuple || Extra Branch]  Out: Split Node*/
-static bool LinearSplit(struct RTNode *L, RTdimension I[], void *Tuple, struct RTNode *Child, struct RTNode **split) {
-   struct RTNode NL[M+1], *seedA = NULL, *seedB = NULL, *LL = NULL, *Parent = NULL;
-   RTchildindex i = 0, A = 1, B = 1;
+/*In: Full Node, Children and Extra Entry  Out: Split Node*/
+static bool LinearSplit(struct RTree *R, struct RTNode *L, struct RTNode NL[], struct RTNode **split) {
+   struct RTNode *seedA = NULL, *seedB = NULL, *LL = NULL;
+   RTchildindex i = 0, A = 1, B = 1, n = R->Max + 1;
    RTdimensionindex j = 0, k = 0;
    long double Larea = 0, Lincrease = 0, LLarea = 0, LLincrease = 0, width[RTn];
    RTdimension Lexpanded[RTn*2], LLexpanded[RTn*2];
 
-   /*Copy children into bigger array*/
-   memcpy(NL, L->Child, M * sizeof(NL[0]));
-
-   /*Copy extra to the end of the array*/
-   if (Tuple) {
-      NL[M].Parent = NULL;
-      memcpy(NL[M].I, I, sizeof(NL[M].I));
-      NL[M].Child = NULL;
-      NL[M].Tuple = Tuple;
-#ifdef RTREE_DEBUG
-   } else if (Child) {
-#else
-   } else {
-#endif
-      memcpy(NL+M, Child, sizeof(NL[M]));
-   }
-#ifdef RTREE_DEBUG
-   else {
-      fputs("rtree on fire!\n", stderr);
-      *split = NULL;
-      return false;
-   }
-#endif
-
-   Parent = L->Parent;
-
    /*Find the width of all sides of L if E was a child*/
    for (j = 0, k = RTn; j < RTn; ++j, ++k) {
-      width[j] = (long double)((NL[M].I[k] > L->I[k]) ? NL[M].I[k] : L->I[k]) - ((NL[M].I[j] < L->I[j]) ? NL[M].I[j] : L->I[j]);
+      width[j] = (long double)((NL[n-1].I[k] > L->I[k]) ? NL[n-1].I[k] : L->I[k]) - ((NL[n-1].I[j] < L->I[j]) ? NL[n-1].I[j] : L->I[j]);
    }
 
    /*
@@ -810,11 +5791,10 @@ static bool LinearSplit(struct RTNode *L, RTdimension I[], void *Tuple, struct R
 
    LL = (struct RTNode *)mem_alloc(sizeof(struct RTNode));
    InitNodes(LL, 1);
-   LL->Child = (struct RTNode *)mem_alloc(M * sizeof(struct RTNode));
-   InitNodes(LL->Child, M);
+   LL->Child = NewChildren(R);
 
    /*LS1 [Pick first entry for each group]*/
-   if (!LinearPickSeeds(NL, width, &seedA, &seedB)) {
+   if (!LinearPickSeeds(NL, R->Max, width, &seedA, &seedB)) {
       *split = NULL;
       return false;
    }
@@ -822,25 +5802,24 @@ static bool LinearSplit(struct RTNode *L, RTdimension I[], void *Tuple, struct R
    /*Last check passed clear L*/
    InitNodes(L->Child, M);
    memset(L->I, 0, sizeof(L->I));
-   L->Parent = NULL;
    L->Tuple = NULL;
 
-   if(!Insert(&L, LEVEL_TOP, NULL, NULL, seedA) || !Insert(&LL, LEVEL_TOP, NULL, NULL, seedB)) {
+   if(!Insert(R, &L, LEVEL_TOP, NULL, NULL, seedA) || !Insert(R, &LL, LEVEL_TOP, NULL, NULL, seedB)) {
       *split = NULL;
       return false;
    }
 
    /*LS2 [Check if done]*/
    /*for loop checks 'if all entries have been assigned' for LS2 and acts as the PickNext algorithm*/
-   for (i = 0; i < M+1; ++i) {
+   for (i = 0; i < n; ++i) {
       if (NL+i != seedA && NL+i != seedB) {
-         if ((M + 1) - (A + B) == m - A) {
-            if(!Insert(&L, LEVEL_TOP, NULL, NULL, NL+i)) {
+         if (n - (A + B) == R->Min - A) {
+            if(!Insert(R, &L, LEVEL_TOP, NULL, NULL, NL+i)) {
                *split = NULL;
                return false;
             }
-         } else if ((M + 1) - (A + B) == m - B) {
-            if(!Insert(&LL, LEVEL_TOP, NULL, NULL, NL+i)) {
+         } else if (n - (A + B) == R->Min - B) {
+            if(!Insert(R, &LL, LEVEL_TOP, NULL, NULL, NL+i)) {
                *split = NULL;
                return false;
             }
@@ -860,25 +5839,25 @@ static bool LinearSplit(struct RTNode *L, RTdimension I[], void *Tuple, struct R
             LLincrease = Volume(LLexpanded) - LLarea;
 
             if (Lincrease < LLincrease || (Lincrease == LLincrease && Larea < LLarea)) {
-               if(!Insert(&L, LEVEL_TOP, NULL, NULL, NL+i)) {
+               if(!Insert(R, &L, LEVEL_TOP, NULL, NULL, NL+i)) {
                   *split = NULL;
                   return false;
                }
                ++A;
             } else if (Lincrease > LLincrease || (Lincrease == LLincrease && Larea > LLarea)) {
-               if(!Insert(&LL, LEVEL_TOP, NULL, NULL, NL+i)) {
+               if(!Insert(R, &LL, LEVEL_TOP, NULL, NULL, NL+i)) {
                   *split = NULL;
                   return false;
                }
                ++B;
             } else if (A < B) {
-               if(!Insert(&L, LEVEL_TOP, NULL, NULL, NL+i)) {
+               if(!Insert(R, &L, LEVEL_TOP, NULL, NULL, NL+i)) {
                   *split = NULL;
                   return false;
                }
                ++A;
             } else {
-               if(!Insert(&LL, LEVEL_TOP, NULL, NULL, NL+i)) {
+               if(!Insert(R, &LL, LEVEL_TOP, NULL, NULL, NL+i)) {
                   *split = NULL;
                   return false;
                }
@@ -888,21 +5867,20 @@ static bool LinearSplit(struct RTNode *L, RTdimension I[], void *Tuple, struct R
       }
    }
 
-   L->Parent = Parent;
    *split = LL;
    return true;
 }
 
 /*Algorithm LinearPickSeeds*/
-/*In: Node List, Node Width  Out: High Best, Low Best*/
-static bool LinearPickSeeds(struct RTNode NL[], long double *width, struct RTNode **hbest, struct RTNode **lbest) {
+/*In: Node List, Entries to Search, Node Width  Out: High Best, Low Best*/
+static bool LinearPickSeeds(struct RTNode NL[], RTchildindex count, long double *width, struct RTNode **hbest, struct RTNode **lbest) {
    long double separation = 0.0, sbest = -1.0;
    RTchildindex i = 0, low = 0, high = 1;
    RTdimensionindex j = 0, k = 0;
 
    /*LPS1 [Find extreme rectangles along all dimensions]*/
    for (j = 0, k = RTn; j < RTn; ++j, ++k) {
-      for (i = 0; i < M; ++i) {
+      for (i = 0; i < count; ++i) {
          if (NL[i].I[j] > NL[low].I[j])
             if (i != high)
                low = i;
@@ -931,6 +5909,395 @@ static bool LinearPickSeeds(struct RTNode NL[], long double *width, struct RTNod
    return false;
 }
 
+/*Level of a node; leaves are LEVEL_LEAF*/
+static size_t NodeLevel(struct RTNode *N) {
+   size_t level;
+
+   for (level = 0; N->Child; ++level, N = N->Child) ;
+
+   return level;
+}
+
+/*Algorithm OverflowTreatment*/
+/*In: Parent Node, Full Node, [Extra Size, Extra Tuple || Extra Branch]  Out: Split Node*/
+static bool OverflowTreatment(struct RTree *R, struct RTNode *P, struct RTNode *L, RTdimension I[], void *Tuple, struct RTNode *Child, struct RTNode **split) {
+   struct RTNode NL[M+1];
+   size_t level;
+
+   /*Copy children and the extra entry into bigger array*/
+   memcpy(NL, L->Child, R->Max * sizeof(NL[0]));
+   if (Tuple) {
+      NL[R->Max] = EMPTY_NODE;
+      memcpy(NL[R->Max].I, I, sizeof(NL[R->Max].I));
+      NL[R->Max].Tuple = Tuple;
+#ifdef RTREE_DEBUG
+   } else if (Child) {
+#else
+   } else {
+#endif
+      NL[R->Max] = *Child;
+   }
+#ifdef RTREE_DEBUG
+   else {
+      fputs("rtree on fire!\n", stderr);
+      *split = NULL;
+      return false;
+   }
+#endif
+
+   /*OT1 [Reinsert on the first overflow of each level, never from the root]*/
+   if (R->Config.Insert == RTInsertRStar && P && (level = NodeLevel(L)) < MAX_HEIGHT && !(R->Reinserted & (uint64_t)1 << level)) {
+      R->Reinserted |= (uint64_t)1 << level;
+      *split = NULL;
+      return Reinsert(R, L, NL, level);
+   }
+
+   /*OT2 [Split]*/
+   if (!SPLIT[R->Config.Split](R, L, NL, split))
+      return false;
+
+   HomeEntries(R, L->Child, 0, M);
+   HomeEntries(R, (*split)->Child, 0, M);
+
+   if (R->Config.Sync == RTSyncLink)
+      LinkSplit(R, L, *split);
+   return true;
+}
+
+/*Algorithm Reinsert*/
+/*The entries forced out wait in R->Pending; inserting them now would reshape the path being adjusted*/
+/*In: Full Node, Children and Extra Entry, Node Level*/
+static bool Reinsert(struct RTree *R, struct RTNode *L, struct RTNode NL[], size_t level) {
+   struct Reinsert *Q = NULL;
+   long double key[M+1], center[RTn], d;
+   RTdimension cover[RTn*2];
+   RTchildindex i, n = R->Max + 1;
+   RTdimensionindex j = 0, k = 0;
+
+   /*RI1 [Compute distances between the centers]*/
+   /*The parent's rectangle may be stale while a split propagates; cover the entries instead*/
+   memcpy(cover, NL[0].I, sizeof(cover));
+   for (i = 1; i < n; ++i)
+      for (j = 0, k = RTn; j < RTn; ++j, ++k) {
+         if (cover[j] > NL[i].I[j])
+            cover[j] = NL[i].I[j];
+         if (cover[k] < NL[i].I[k])
+            cover[k] = NL[i].I[k];
+      }
+
+   /*Centers are doubled; only their order matters*/
+   for (j = 0, k = RTn; j < RTn; ++j, ++k)
+      center[j] = (long double)cover[j] + cover[k];
+
+   for (i = 0; i < n; ++i)
+      for (key[i] = 0, j = 0, k = RTn; j < RTn; ++j, ++k) {
+         d = (long double)NL[i].I[j] + NL[i].I[k] - center[j];
+         key[i] += d * d;
+      }
+
+   /*RI2 [Sort by distance, farthest last]*/
+   SortNodes(NL, key, n);
+
+   /*RI3 [Remove the farthest entries]*/
+   FillNode(L, NL, n - RSTAR_REINSERT(R));
+   HomeEntries(R, L->Child, 0, M);
+
+   /*RI4 [Queue them for reinsertion, closest first]*/
+   for (i = n-1; i > n-1 - RSTAR_REINSERT(R); --i) {
+      Q = (struct Reinsert *)mem_alloc(sizeof(struct Reinsert));
+      Q->Level = level;
+      Q->Node = NL[i];
+      Q->Next = R->Pending;
+      R->Pending = Q;
+   }
+
+   return true;
+}
+
+/*Inserts the entries queued by Reinsert*/
+static bool ReinsertPending(struct RTree *R) {
+   struct Reinsert *Q = NULL;
+
+   while ((Q = R->Pending) != NULL) {
+      R->Pending = Q->Next;
+      if (!Insert(R, &R->Root, Q->Level, NULL, NULL, &Q->Node)) {
+         free(Q);
+         while ((Q = R->Pending) != NULL) {
+            R->Pending = Q->Next;
+            free(Q);
+         }
+         return false;
+      }
+      free(Q);
+   }
+
+   return true;
+}
+
+/*Returns how much a shape grows to cover an entry*/
+static long double Enlargement(RTdimension *S, RTdimension *E) {
+   RTdimensionindex j = 0, k = 0;
+   RTdimension expanded[RTn*2];
+
+   for (j = 0, k = RTn; j < RTn; ++j, ++k) {
+      expanded[j] = ( E[j] < S[j] ) ? E[j] : S[j];
+      expanded[k] = ( E[k] > S[k] ) ? E[k] : S[k];
+   }
+
+   return Volume(expanded) - Volume(S);
+}
+
+/*Covers of every prefix and suffix of the entries*/
+/*In: Entries, Entry Count  Out: Cover of NL[0..i], Cover of NL[i..n-1]*/
+static void CoverEntries(struct RTNode NL[], RTchildindex n, RTdimension front[][RTn*2], RTdimension back[][RTn*2]) {
+   RTchildindex i, last = n - 1;
+   RTdimensionindex j = 0, k = 0;
+
+   memcpy(front[0], NL[0].I, sizeof(front[0]));
+   memcpy(back[last], NL[last].I, sizeof(back[last]));
+   for (i = 1; i < n; ++i)
+      for (j = 0, k = RTn; j < RTn; ++j, ++k) {
+         front[i][j] = front[i-1][j] < NL[i].I[j] ? front[i-1][j] : NL[i].I[j];
+         front[i][k] = front[i-1][k] > NL[i].I[k] ? front[i-1][k] : NL[i].I[k];
+         back[last-i][j] = back[last-i+1][j] < NL[last-i].I[j] ? back[last-i+1][j] : NL[last-i].I[j];
+         back[last-i][k] = back[last-i+1][k] > NL[last-i].I[k] ? back[last-i+1][k] : NL[last-i].I[k];
+      }
+}
+
+/*Algorithm Split*/
+/*In: Full Node, Children and Extra Entry  Out: Split Node*/
+static bool RStarSplit(struct RTree *R, struct RTNode *L, struct RTNode NL[], struct RTNode **split) {
+   struct RTNode *LL = NULL;
+   RTdimension front[M+1][RTn*2], back[M+1][RTn*2];
+   long double key[M+1], margin = 0, overlap = 0, area = 0, best = LDBL_MAX, minarea = LDBL_MAX;
+   RTchildindex i, n = R->Max + 1, count = RSTAR_MIN(R);
+   RTdimensionindex axis = 0, j, side = 0, bound = 0;
+
+   /*S1 [ChooseSplitAxis, the one with the least margin over all distributions]*/
+   for (j = 0; j < RTn; ++j) {
+      /*Entries sorted by their lower, then by their upper value*/
+      for (margin = 0, side = 0; side < 2; ++side) {
+         for (i = 0; i < n; ++i)
+            key[i] = NL[i].I[j + side*RTn];
+         SortNodes(NL, key, n);
+         CoverEntries(NL, n, front, back);
+
+         for (i = RSTAR_MIN(R); i <= n - RSTAR_MIN(R); ++i)
+            margin += Margin(front[i-1]) + Margin(back[i]);
+      }
+
+      if (margin < best) {
+         best = margin;
+         axis = j;
+      }
+   }
+
+   /*S2 [ChooseSplitIndex, least overlap then least area]*/
+   best = LDBL_MAX;
+   for (side = 0; side < 2; ++side) {
+      for (i = 0; i < n; ++i)
+         key[i] = NL[i].I[axis + side*RTn];
+      SortNodes(NL, key, n);
+      CoverEntries(NL, n, front, back);
+
+      for (i = RSTAR_MIN(R); i <= n - RSTAR_MIN(R); ++i) {
+         overlap = Intersection(front[i-1], back[i]);
+         area = Volume(front[i-1]) + Volume(back[i]);
+         if (overlap < best || (overlap == best && area < minarea)) {
+            best = overlap;
+            minarea = area;
+            count = i;
+            bound = side;
+         }
+      }
+   }
+
+   /*S3 [Distribute the entries into two groups]*/
+   if (bound == 0) {
+      for (i = 0; i < n; ++i)
+         key[i] = NL[i].I[axis];
+      SortNodes(NL, key, n);
+   }
+
+   LL = (struct RTNode *)mem_alloc(sizeof(struct RTNode));
+   if (!FillNode(L, NL, count) || !PackNode(R, LL, NL+count, n - count)) {
+      free(LL);
+      *split = NULL;
+      return false;
+   }
+
+   *split = LL;
+   return true;
+}
+
+/*3.5.2 A Quadratic-Cost Algorithm*/
+/*Algorithm QuadraticSplit*/
+/*In: Full Node, Children and Extra Entry  Out: Split Node*/
+static bool QuadraticSplit(struct RTree *R, struct RTNode *L, struct RTNode NL[], struct RTNode **split) {
+   bool assigned[M+1], group[M+1], g;
+   RTdimension cover[2][RTn*2];
+   long double area[2], d[2], best[2] = {0, 0}, diff, most;
+   RTchildindex n = R->Max + 1, count[2] = {1, 1}, seed[2], left = n - 2, i, next = 0;
+   RTdimensionindex j = 0, k = 0;
+
+   memset(assigned, 0, sizeof(assigned));
+
+   /*QS1 [Pick first entry for each group]*/
+   QuadraticPickSeeds(NL, n, seed, seed+1);
+   for (i = 0; i < 2; ++i) {
+      assigned[seed[i]] = true;
+      group[seed[i]] = i;
+      memcpy(cover[i], NL[seed[i]].I, sizeof(cover[i]));
+   }
+
+   /*QS2 [Check if done]*/
+   while (left > 0) {
+      /*A group with too few entries takes all the rest*/
+      if (count[0] + left == R->Min || count[1] + left == R->Min) {
+         g = count[1] + left == R->Min;
+         for (i = 0; i < n; ++i)
+            if (!assigned[i]) {
+               assigned[i] = true;
+               group[i] = g;
+            }
+         break;
+      }
+
+      /*QS3 [Select entry to assign]*/
+      /*PN1 [Determine cost of putting each entry in each group]*/
+      area[0] = Volume(cover[0]);
+      area[1] = Volume(cover[1]);
+      for (most = -1, i = 0; i < n; ++i)
+         if (!assigned[i]) {
+            d[0] = Enlargement(cover[0], NL[i].I);
+            d[1] = Enlargement(cover[1], NL[i].I);
+
+            /*PN2 [Find entry with greatest preference for one group]*/
+            diff = d[0] > d[1] ? d[0] - d[1] : d[1] - d[0];
+            if (diff > most) {
+               most = diff;
+               next = i;
+               best[0] = d[0];
+               best[1] = d[1];
+            }
+         }
+
+      /*Least enlargement, then smaller area, then fewer entries*/
+      g = best[1] < best[0] || (best[1] == best[0] && (area[1] < area[0] || (area[1] == area[0] && count[1] < count[0])));
+      assigned[next] = true;
+      group[next] = g;
+      ++count[g];
+      --left;
+      for (j = 0, k = RTn; j < RTn; ++j, ++k) {
+         if (cover[g][j] > NL[next].I[j])
+            cover[g][j] = NL[next].I[j];
+         if (cover[g][k] < NL[next].I[k])
+            cover[g][k] = NL[next].I[k];
+      }
+   }
+
+   return SplitGroups(R, L, NL, group, split);
+}
+
+/*Algorithm QuadraticPickSeeds*/
+/*In: Node List, Entry Count  Out: Seed Entries*/
+static void QuadraticPickSeeds(struct RTNode NL[], RTchildindex n, RTchildindex *seedA, RTchildindex *seedB) {
+   RTchildindex h, i;
+   RTdimensionindex j = 0, k = 0;
+   RTdimension J[RTn*2];
+   long double area[M+1], d, most = -LDBL_MAX;
+
+   for (i = 0; i < n; ++i)
+      area[i] = Volume(NL[i].I);
+
+   /*PS1 [Calculate inefficiency of grouping entries together]*/
+   for (h = 0; h < n-1; ++h)
+      for (i = h+1; i < n; ++i) {
+         for (j = 0, k = RTn; j < RTn; ++j, ++k) {
+            J[j] = ( NL[h].I[j] < NL[i].I[j] ) ? NL[h].I[j] : NL[i].I[j];
+            J[k] = ( NL[h].I[k] > NL[i].I[k] ) ? NL[h].I[k] : NL[i].I[k];
+         }
+         d = Volume(J) - area[h] - area[i];
+
+         /*PS2 [Choose the most wasteful pair]*/
+         if (d > most) {
+            most = d;
+            *seedA = h;
+            *seedB = i;
+         }
+      }
+}
+
+/*Greene: An Implementation and Performance Analysis of Spatial Data Access Methods, Proc. 1989 ICDE*/
+/*Algorithm GreeneSplit*/
+/*In: Full Node, Children and Extra Entry  Out: Split Node*/
+static bool GreeneSplit(struct RTree *R, struct RTNode *L, struct RTNode NL[], struct RTNode **split) {
+   RTdimension front[M+1][RTn*2], back[M+1][RTn*2];
+   long double key[M+1], separation, best = -LDBL_MAX;
+   RTchildindex seedA, seedB, i, n = R->Max + 1, half = n / 2;
+   RTdimensionindex axis = 0, j = 0, k = 0;
+   bool group[M+1];
+
+   /*GS1 [Choose the axis separating the quadratic seeds most, relative to the node's width]*/
+   QuadraticPickSeeds(NL, n, &seedA, &seedB);
+   CoverEntries(NL, n, front, back);
+   for (j = 0, k = RTn; j < RTn; ++j, ++k) {
+      separation = ((long double)(NL[seedA].I[j] > NL[seedB].I[j] ? NL[seedA].I[j] : NL[seedB].I[j])
+                  - (NL[seedA].I[k] < NL[seedB].I[k] ? NL[seedA].I[k] : NL[seedB].I[k]))
+                  / ((long double)front[n-1][k] - front[n-1][j] + GRAIN);
+      if (separation > best) {
+         best = separation;
+         axis = j;
+      }
+   }
+
+   /*GS2 [Sort by the low value along the axis]*/
+   for (i = 0; i < n; ++i)
+      key[i] = NL[i].I[axis];
+   SortNodes(NL, key, n);
+
+   /*GS3 [Give each group half, the odd entry to the group it enlarges least]*/
+   for (i = 0; i < n; ++i)
+      group[i] = i >= half;
+   if (n % 2) {
+      CoverEntries(NL, n, front, back);
+      group[half] = Enlargement(back[half+1], NL[half].I) < Enlargement(front[half-1], NL[half].I);
+   }
+
+   return SplitGroups(R, L, NL, group, split);
+}
+
+/*Moves entries of group false into the full node and group true into a new node*/
+/*In: Full Node, Children and Extra Entry, Groups  Out: Split Node*/
+static bool SplitGroups(struct RTree *R, struct RTNode *L, struct RTNode NL[], bool group[], struct RTNode **split) {
+   struct RTNode A[M+1], B[M+1], *LL = NULL;
+   RTchildindex a = 0, b = 0, i;
+
+   for (i = 0; i < R->Max + 1; ++i)
+      if (group[i])
+         B[b++] = NL[i];
+      else
+         A[a++] = NL[i];
+
+#ifdef RTREE_DEBUG
+   if (a < R->Min || b < R->Min || a > R->Max || b > R->Max) {
+      fputs("rtree on fire!\n", stderr);
+      *split = NULL;
+      return false;
+   }
+#endif
+
+   LL = (struct RTNode *)mem_alloc(sizeof(struct RTNode));
+   if (!FillNode(L, A, a) || !PackNode(R, LL, B, b)) {
+      free(LL);
+      *split = NULL;
+      return false;
+   }
+
+   *split = LL;
+   return true;
+}
+
 #ifdef RTREE_DEBUG
 #include <math.h>   /*pow*/
 
@@ -953,7 +6320,7 @@ bool RTTrace(struct RTNode *Start, size_t Level, size_t AbsChild, struct RTNode
       }
 
       Start = Start->Child+factor;
-      if (Start->Parent == NULL) {
+      if (IS_EMPTY(*Start)) {
          *Out = NULL;
          return true;
       }
@@ -983,9 +6350,8 @@ bool RTDump(struct RTNode *Start, const char *filename) {
 
    fprintf(log, "%s %14p %s\n", pad, Start, pad);
    for(k = 0; k < RTn*2; ++k) {
-      fprintf(log, "%s %d-%12d %s\n", pad, k, Start->I[k], pad);
+      fprintf(log, "%s %d-%12Lg %s\n", pad, k, (long double)Start->I[k], pad);
    }
-   fprintf(log, "%s %14p %s\n", pad, Start->Parent, pad);
    fprintf(log, "%s %14p %s\n", pad, Start->Child, pad);
    fprintf(log, "%s %14p %s\n\n", pad, Start->Tuple, pad);
 
@@ -1028,7 +6394,7 @@ bool RTDump(struct RTNode *Start, const char *filename) {
                pad[size/2] = '\0';
 
             if(curr)
-               fprintf(log, "%s %d-%12d ", pad, k, curr->I[k]);
+               fprintf(log, "%s %d-%12Lg ", pad, k, (long double)curr->I[k]);
             else
                fprintf(log, "%s XXXXXXXXXXXXXX ", pad);
 
@@ -1044,30 +6410,6 @@ bool RTDump(struct RTNode *Start, const char *filename) {
       fputs("\n", log);
       }
 
-      for (j = 0; j < cnt; ++j) {
-         if (!trace(Start, i, j, &curr)) {
-            fclose(log);
-            return false;
-         }
-         if (j == 0 && size > 0)
-            pad[size/2] = '\0';
-
-         if(curr)
-            fprintf(log, "%s %14p ", pad, curr->Parent);
-         else
-            fprintf(log, "%s XXXXXXXXXXXXXX ", pad);
-
-         if (j == 0 && size > 0)
-            pad[size/2] = ' ';
-
-         if (j == cnt - 1 && size > 0) {
-            pad[size/2] = '\0';
-            fputs(pad, log);
-            pad[size/2] = ' ';
-         }
-      }
-      fputs("\n", log);
-
       for (j = 0; j < cnt; ++j) {
          if (!trace(Start, i, j, &curr)) {
             fclose(log);
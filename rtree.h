@@ -1,5 +1,5 @@
-#ifndef _RTREE_
-#define _RTREE_
+#ifndef _RTREE_COMMON_
+#define _RTREE_COMMON_
 
 /*
  * Antonin Guttman: R-Trees: A Dynamic Index Structure for Spatial Searching
@@ -10,14 +10,123 @@
 
 #include <stdbool.h> /*bool*/
 #include <stddef.h> /*size_t*/
-#include <stdint.h> /*uint_fast8_t, int_fast32_t*/
+#include <stdint.h> /*uint_fast8_t, uint_fast16_t, int_fast32_t*/
 
-typedef int_fast32_t RTdimension;
 typedef uint_fast8_t RTdimensionindex;
-typedef uint_fast8_t RTchildindex;
+typedef uint_fast16_t RTchildindex; /*wide enough for the fanout of pages far past RTPS 4096*/
+
+#ifndef RTPS
+#define RTPS 4096 /*Pagesize; a node's children share one page, which bounds the fanout*/
+#endif
+
+/*
+ * Define RTREE_SOA to give every node a dense copy of its children's boxes, one
+ * array per side, so searches test a whole node with linear scans.  With GCC
+ * or Clang on x86 those scans use SSE4.2, AVX2 or AVX-512, whichever the CPU
+ * running the program supports.  The child records keep their own boxes, so
+ * each child costs RTn*2 coordinates more: with two int_fast32_t dimensions on
+ * 64 bit Linux a 4 KB page holds 51 children instead of 85.  The duplicate
+ * buys a layout nothing but the searches sees.  Splits, reinsertion, loading
+ * and every other writer move whole records as before, and the copy is
+ * refreshed once per changed node, after its records.  Holding the boxes only
+ * in the dense arrays would mean redoing each of those writers over columns.
+ * Raise RTPS where the fanout matters more.
+ *
+ * Define RTREE_COUNT to keep in every branch the number of entries below it, so
+ * RTSelectCount adds up subtrees lying within the search box without reading
+ * them.  Nodes hold a size_t more each, and so a page holds fewer of them.
+ *
+ * Define RTREE_LHV to keep in every entry its largest Hilbert value, so
+ * RTInsertHilbert compares stored values on its way down instead of finding
+ * each subtree's last entry and recomputing its key.  Hilbert insertion runs
+ * about three times faster, but every node holds a uint64_t more, so a 4 KB
+ * page holds 73 children instead of 85 whether the tree uses Hilbert order or not.
+ */
+
+enum RTLoad {
+   RTLoadList,   /*pack entries in list order*/
+   RTLoadSTR,    /*Sort-Tile-Recursive*/
+   RTLoadHilbert /*pack entries in Hilbert order of their centers*/
+};
+
+enum RTInsert {
+   RTInsertGuttman, /*least enlargement ChooseLeaf and LinearSplit*/
+   RTInsertHilbert, /*nodes kept in Hilbert order with deferred 2-to-3 splits*/
+   RTInsertRStar    /*R*-tree overlap ChooseSubtree, forced reinsertion and topological split*/
+};
+
+enum RTSplit {
+   RTSplitDefault,   /*the insertion method's own split*/
+   RTSplitLinear,    /*Guttman's linear cost split*/
+   RTSplitQuadratic, /*Guttman's quadratic cost split*/
+   RTSplitRStar,     /*least margin axis, least overlap distribution*/
+   RTSplitGreene     /*halves sorted along the axis separating the quadratic seeds most*/
+};
+
+enum RTPool {
+   RTPoolNone,  /*each child array from malloc*/
+   RTPoolPages, /*page aligned child arrays from per tree chunks, recycled on free lists*/
+   RTPoolHuge   /*as RTPoolPages, with chunks backed by huge pages where the system allows*/
+};
+
+enum RTSync {
+   RTSyncNone, /*callers serialize every call on a tree*/
+   RTSyncRCU,  /*readers need no locks and run alongside one writer, seeing the tree as of its last finished write*/
+   RTSyncLink  /*any number of readers and writers at once; readers see each write as it finishes*/
+               /*deletes never condense, so nodes stay underfull and boxes may cover more than needed,*/
+               /*and no child array is freed before RTFreeTree, so a tree keeps the memory of its largest size*/
+};
+
+/*Child array allocations of one tree*/
+struct RTAllocStats {
+   size_t Blocks;   /*child arrays in use*/
+   size_t Peak;     /*most child arrays in use at once*/
+   size_t Allocs;   /*child arrays handed out*/
+   size_t Frees;    /*child arrays given back*/
+   size_t Chunks;   /*pool chunks held*/
+   size_t Huge;     /*pool chunks backed by, or advised to use, huge pages*/
+   size_t Reserved; /*bytes held by the pool*/
+};
+
+/*Buffer pool of one paged tree; its hit rate is Hits / (Hits + Misses)*/
+struct RTPageStats {
+   size_t Frames;    /*pages the pool holds*/
+   size_t Hits;      /*pages found in the pool*/
+   size_t Misses;    /*pages read from the file*/
+   size_t Writes;    /*dirty pages written back*/
+   size_t Evictions; /*pages pushed out for others*/
+   size_t Pages;     /*pages in the file*/
+};
+
+#endif /* _RTREE_COMMON_ */
+
+/*
+ * The rest is declared once per coordinate type and dimension count.  Plain
+ * RT names use RTn dimensions of RTdimension.  With RTREE_SPEC(name) defined,
+ * rtree_spec.h renames every public name through it and RTn and RTREE_COORD
+ * pick the shape; rtree_2i32.h and its siblings are such specializations.
+ * New public names must be added to rtree_spec.h.
+ */
+#if defined(RTREE_SPEC) || !defined(_RTREE_)
+#ifdef RTREE_SPEC
+#include "rtree_spec.h"
+#else
+#define _RTREE_
+#endif
 
+#ifndef RTn
 #define RTn 2     /*dimensions; sizeof dimensionindex*/
-#define RTPS 4096 /*Pagesize*/
+#endif
+
+#ifdef RTREE_SPEC
+enum {RTREE_SPEC(n) = RTn}; /*dimensions, still known once RTn is undefined*/
+#endif
+
+#ifdef RTREE_COORD
+typedef RTREE_COORD RTdimension;
+#else
+typedef int_fast32_t RTdimension;
+#endif
 
 struct RTNodeList {
    struct RTNodeList *Next;
@@ -25,21 +134,115 @@ struct RTNodeList {
    RTdimension I[RTn*2];
 };
 
+/*Entry of an array to bulk load*/
+struct RTEntry {
+   void *Tuple;
+   RTdimension I[RTn*2];
+};
+
+struct RTConfig {
+   enum RTLoad Load;           /*bulk loading method*/
+   double Fill;                /*fraction of each node filled by bulk loading; 0 fills nodes*/
+   enum RTInsert Insert;       /*dynamic insertion method*/
+   enum RTSplit Split;         /*node split method; not used by Hilbert insertion*/
+   RTdimension Bounds[RTn*2];  /*extent of the Hilbert curve; all 0 covers the bulk loaded entries, and is refused for an empty tree under Hilbert insertion*/
+                               /*centers outside it are clamped to its edge, so entries beyond it share keys and cluster poorly*/
+   enum RTPool Pool;           /*child array allocator*/
+   RTchildindex Fanout;        /*most children per node, from 4 up to what a page holds; 0 fills the page*/
+   RTchildindex MinFanout;     /*fewest children per node but the root, from 2 up to half the Fanout; 0 uses 2*/
+   enum RTSync Sync;           /*sharing between threads*/
+   size_t Threads;             /*bulk loading, batch search and join threads; 0 uses one per processor*/
+   bool Index;                 /*keep a hash from each Tuple to its leaf, so deletes and updates skip FindLeaf; RTSyncNone only*/
+};
+
+/*Caller owned hit buffer; zero initialize it and reuse it across queries*/
+struct RTResult {
+   void *Tuple;
+   RTdimension I[RTn*2];
+   long double Distance; /*from the query of a nearest neighbour search; 0 otherwise*/
+};
+
+struct RTResults {
+   struct RTResult *Result;
+   size_t Count;    /*hits from the last query*/
+   size_t Capacity; /*hits that fit before the buffer grows*/
+};
+
 struct RTNode;
-typedef struct RTNode * RTreePtr;
+struct RTree;
+typedef struct RTree * RTreePtr;
+
+/*Resumable search; any change to the tree invalidates open cursors, but under RTSyncRCU they keep the tree as it was*/
+/*and under RTSyncLink they go on, returning each entry left in place from opening to closing once*/
+struct RTCursor;
+
+/*Nearest neighbour browse returning hits by increasing distance; changes to the tree affect it as they do cursors*/
+struct RTNearest;
+
+/*Read only tree opened from a file written by RTSaveTree*/
+struct RTMapped;
+
+/*Tree kept in the pages of a file, of which a fixed pool of frames is in memory; callers serialize every call on one*/
+struct RTPaged;
+
+/*Called for each hit with its Size and Tuple; returning false stops the search*/
+typedef bool (*RTVisitor)(RTdimension I[], void *Tuple, void *ctx);
+
+/*Distance from the query P to an entry of Size I; Tuple is NULL for the cover of a subtree*/
+/*A subtree's distance must not exceed the distance to any entry inside it*/
+typedef long double (*RTDistance)(RTdimension P[], RTdimension I[], void *Tuple, void *ctx);
+
+/*64 bit id a saved tree stores in place of a Tuple*/
+typedef uint64_t (*RTTupleId)(void *Tuple, void *ctx);
+
+/*Called for each hit of a mapped tree with its Size and stored id; returning false stops the search*/
+typedef bool (*RTMappedVisitor)(RTdimension I[], uint64_t Id, void *ctx);
+
+/*Called for each pair of overlapping entries of a join, the first from tree A; returning false stops the join*/
+typedef bool (*RTJoinVisitor)(RTdimension IA[], void *TupleA, RTdimension IB[], void *TupleB, void *ctx);
 
 bool RTNewTree(RTreePtr *T, struct RTNodeList *list);
+bool RTNewTreeConfig(RTreePtr *T, struct RTNodeList *list, const struct RTConfig *config);
+bool RTNewTreeArray(RTreePtr *T, const struct RTEntry *entries, size_t count, const struct RTConfig *config);
 bool RTSelectTuple(RTreePtr *T, RTdimension S[], struct RTNodeList **list, size_t *count);
+bool RTSelectResults(RTreePtr *T, RTdimension S[], struct RTResults *results, size_t *count);
+bool RTFreeResults(struct RTResults *results);
+bool RTSelectBatch(RTreePtr *T, RTdimension S[][RTn*2], size_t count, RTVisitor visit, void *ctx[], struct RTResults results[]);
+bool RTSelectCount(RTreePtr *T, RTdimension S[], size_t *count);
+bool RTSelectVisit(RTreePtr *T, RTdimension S[], RTVisitor visit, void *ctx);
+bool RTJoin(RTreePtr *A, RTreePtr *B, RTJoinVisitor visit, void *ctx);
+bool RTJoinParallel(RTreePtr *A, RTreePtr *B, RTJoinVisitor visit, void *ctx);
+bool RTOpenCursor(RTreePtr *T, RTdimension S[], struct RTCursor **C);
+bool RTFetchCursor(struct RTCursor *C, struct RTResults *results, size_t K, size_t *count);
+bool RTCloseCursor(struct RTCursor **C);
+bool RTSelectNearest(RTreePtr *T, RTdimension P[], size_t K, struct RTResults *results, size_t *count);
+bool RTOpenNearest(RTreePtr *T, RTdimension P[], RTDistance distance, void *ctx, struct RTNearest **C);
+bool RTFetchNearest(struct RTNearest *C, struct RTResults *results, size_t K, size_t *count);
+bool RTCloseNearest(struct RTNearest **C);
 bool RTSelectDimensions(RTreePtr *T, RTdimension I[]);
+bool RTSelectAllocStats(RTreePtr *T, struct RTAllocStats *stats);
 bool RTInsertTuple(RTreePtr *T, RTdimension I[], void *Tuple);
 bool RTDeleteTuple(RTreePtr *T, RTdimension I[], void *Tuple);
+bool RTInsertBatch(RTreePtr *T, const struct RTEntry entries[], size_t count);
+bool RTDeleteBatch(RTreePtr *T, const struct RTEntry entries[], size_t count, size_t *deleted);
 bool RTUpdateTuple(RTreePtr *T, RTdimension I[], void *Tuple, void *New);
 bool RTUpdateDimensions(RTreePtr *T, RTdimension I[], void *Tuple, RTdimension New[]);
 bool RTFreeTree(RTreePtr *T);
+bool RTSaveTree(RTreePtr *T, const char *filename, RTTupleId id, void *ctx);
+bool RTOpenMapped(struct RTMapped **T, const char *filename);
+bool RTSelectMapped(struct RTMapped *T, RTdimension S[], RTMappedVisitor visit, void *ctx);
+bool RTCloseMapped(struct RTMapped **T);
+bool RTOpenPaged(struct RTPaged **T, const char *filename, size_t frames);
+bool RTInsertPaged(struct RTPaged *T, RTdimension I[], uint64_t Id);
+bool RTDeletePaged(struct RTPaged *T, RTdimension I[], uint64_t Id);
+bool RTSelectPaged(struct RTPaged *T, RTdimension S[], RTMappedVisitor visit, void *ctx);
+bool RTSelectPageStats(struct RTPaged *T, struct RTPageStats *stats);
+bool RTFlushPaged(struct RTPaged *T);
+bool RTClosePaged(struct RTPaged **T);
 
 #ifdef RTREE_DEBUG
 bool RTTrace(struct RTNode *Start, size_t Level, size_t AbsChild, struct RTNode **Out);
 bool RTDump(struct RTNode *Start, const char *filename);
 #endif
 
-#endif /* _RTREE_ */
+#endif /* RTREE_SPEC || _RTREE_ */
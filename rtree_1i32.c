@@ -0,0 +1,5 @@
+/*rtree.c built for rtree_1i32.h*/
+#define RTREE_SPEC(name) rtree_1i32_##name
+#define RTn 1
+#define RTREE_COORD int32_t
+#include "rtree.c"
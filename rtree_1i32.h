@@ -0,0 +1,12 @@
+#ifndef _RTREE_1I32_
+#define _RTREE_1I32_
+
+/*1D int32_t intervals; RTNewTree becomes rtree_1i32_NewTree and so on*/
+#define RTREE_SPEC(name) rtree_1i32_##name
+#define RTn 1
+#define RTREE_COORD int32_t
+#include "rtree.h"
+#define RTREE_UNSPEC
+#include "rtree_spec.h"
+
+#endif /* _RTREE_1I32_ */
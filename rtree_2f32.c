@@ -0,0 +1,5 @@
+/*rtree.c built for rtree_2f32.h*/
+#define RTREE_SPEC(name) rtree_2f32_##name
+#define RTn 2
+#define RTREE_COORD float
+#include "rtree.c"
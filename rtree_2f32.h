@@ -0,0 +1,12 @@
+#ifndef _RTREE_2F32_
+#define _RTREE_2F32_
+
+/*2D float boxes; RTNewTree becomes rtree_2f32_NewTree and so on*/
+#define RTREE_SPEC(name) rtree_2f32_##name
+#define RTn 2
+#define RTREE_COORD float
+#include "rtree.h"
+#define RTREE_UNSPEC
+#include "rtree_spec.h"
+
+#endif /* _RTREE_2F32_ */
@@ -0,0 +1,5 @@
+/*rtree.c built for rtree_2i32.h*/
+#define RTREE_SPEC(name) rtree_2i32_##name
+#define RTn 2
+#define RTREE_COORD int32_t
+#include "rtree.c"
@@ -0,0 +1,12 @@
+#ifndef _RTREE_2I32_
+#define _RTREE_2I32_
+
+/*2D int32_t boxes; RTNewTree becomes rtree_2i32_NewTree and so on*/
+#define RTREE_SPEC(name) rtree_2i32_##name
+#define RTn 2
+#define RTREE_COORD int32_t
+#include "rtree.h"
+#define RTREE_UNSPEC
+#include "rtree_spec.h"
+
+#endif /* _RTREE_2I32_ */
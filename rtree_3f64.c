@@ -0,0 +1,5 @@
+/*rtree.c built for rtree_3f64.h*/
+#define RTREE_SPEC(name) rtree_3f64_##name
+#define RTn 3
+#define RTREE_COORD double
+#include "rtree.c"
@@ -0,0 +1,12 @@
+#ifndef _RTREE_3F64_
+#define _RTREE_3F64_
+
+/*3D double boxes; RTNewTree becomes rtree_3f64_NewTree and so on*/
+#define RTREE_SPEC(name) rtree_3f64_##name
+#define RTn 3
+#define RTREE_COORD double
+#include "rtree.h"
+#define RTREE_UNSPEC
+#include "rtree_spec.h"
+
+#endif /* _RTREE_3F64_ */
@@ -0,0 +1,140 @@
+/*
+ * Renames the public names of rtree.h for one specialization.  Included by
+ * rtree.h while RTREE_SPEC(name) is defined, so that every tree shape gets its
+ * own types and functions, e.g. RTNewTree becomes RTREE_SPEC(NewTree).
+ * Included again with RTREE_UNSPEC defined, it lifts the renames and the
+ * shape settings, letting a file declare several specializations in a row.
+ */
+
+#ifndef RTREE_UNSPEC
+
+#ifdef _RTREE_
+#error "Include rtree specializations before rtree.h"
+#endif
+
+#define RTdimension RTREE_SPEC(dimension)
+#define RTNodeList RTREE_SPEC(NodeList)
+#define RTEntry RTREE_SPEC(Entry)
+#define RTConfig RTREE_SPEC(Config)
+#define RTResult RTREE_SPEC(Result)
+#define RTResults RTREE_SPEC(Results)
+#define RTNode RTREE_SPEC(Node)
+#define RTree RTREE_SPEC(Tree)
+#define RTreePtr RTREE_SPEC(TreePtr)
+#define RTCursor RTREE_SPEC(Cursor)
+#define RTNearest RTREE_SPEC(Nearest)
+#define RTVisitor RTREE_SPEC(Visitor)
+#define RTDistance RTREE_SPEC(Distance)
+#define RTMapped RTREE_SPEC(Mapped)
+#define RTPaged RTREE_SPEC(Paged)
+#define RTTupleId RTREE_SPEC(TupleId)
+#define RTMappedVisitor RTREE_SPEC(MappedVisitor)
+#define RTJoinVisitor RTREE_SPEC(JoinVisitor)
+#define RTNewTree RTREE_SPEC(NewTree)
+#define RTNewTreeConfig RTREE_SPEC(NewTreeConfig)
+#define RTNewTreeArray RTREE_SPEC(NewTreeArray)
+#define RTSelectTuple RTREE_SPEC(SelectTuple)
+#define RTSelectResults RTREE_SPEC(SelectResults)
+#define RTFreeResults RTREE_SPEC(FreeResults)
+#define RTSelectBatch RTREE_SPEC(SelectBatch)
+#define RTSelectCount RTREE_SPEC(SelectCount)
+#define RTSelectVisit RTREE_SPEC(SelectVisit)
+#define RTJoin RTREE_SPEC(Join)
+#define RTJoinParallel RTREE_SPEC(JoinParallel)
+#define RTOpenCursor RTREE_SPEC(OpenCursor)
+#define RTFetchCursor RTREE_SPEC(FetchCursor)
+#define RTCloseCursor RTREE_SPEC(CloseCursor)
+#define RTSelectNearest RTREE_SPEC(SelectNearest)
+#define RTOpenNearest RTREE_SPEC(OpenNearest)
+#define RTFetchNearest RTREE_SPEC(FetchNearest)
+#define RTCloseNearest RTREE_SPEC(CloseNearest)
+#define RTSelectDimensions RTREE_SPEC(SelectDimensions)
+#define RTSelectAllocStats RTREE_SPEC(SelectAllocStats)
+#define RTInsertTuple RTREE_SPEC(InsertTuple)
+#define RTDeleteTuple RTREE_SPEC(DeleteTuple)
+#define RTInsertBatch RTREE_SPEC(InsertBatch)
+#define RTDeleteBatch RTREE_SPEC(DeleteBatch)
+#define RTUpdateTuple RTREE_SPEC(UpdateTuple)
+#define RTUpdateDimensions RTREE_SPEC(UpdateDimensions)
+#define RTFreeTree RTREE_SPEC(FreeTree)
+#define RTSaveTree RTREE_SPEC(SaveTree)
+#define RTOpenMapped RTREE_SPEC(OpenMapped)
+#define RTSelectMapped RTREE_SPEC(SelectMapped)
+#define RTCloseMapped RTREE_SPEC(CloseMapped)
+#define RTOpenPaged RTREE_SPEC(OpenPaged)
+#define RTInsertPaged RTREE_SPEC(InsertPaged)
+#define RTDeletePaged RTREE_SPEC(DeletePaged)
+#define RTSelectPaged RTREE_SPEC(SelectPaged)
+#define RTSelectPageStats RTREE_SPEC(SelectPageStats)
+#define RTFlushPaged RTREE_SPEC(FlushPaged)
+#define RTClosePaged RTREE_SPEC(ClosePaged)
+#define RTTrace RTREE_SPEC(Trace)
+#define RTDump RTREE_SPEC(Dump)
+
+#else
+
+#undef RTdimension
+#undef RTNodeList
+#undef RTEntry
+#undef RTConfig
+#undef RTResult
+#undef RTResults
+#undef RTNode
+#undef RTree
+#undef RTreePtr
+#undef RTCursor
+#undef RTNearest
+#undef RTVisitor
+#undef RTDistance
+#undef RTMapped
+#undef RTPaged
+#undef RTTupleId
+#undef RTMappedVisitor
+#undef RTJoinVisitor
+#undef RTNewTree
+#undef RTNewTreeConfig
+#undef RTNewTreeArray
+#undef RTSelectTuple
+#undef RTSelectResults
+#undef RTFreeResults
+#undef RTSelectBatch
+#undef RTSelectCount
+#undef RTSelectVisit
+#undef RTJoin
+#undef RTJoinParallel
+#undef RTOpenCursor
+#undef RTFetchCursor
+#undef RTCloseCursor
+#undef RTSelectNearest
+#undef RTOpenNearest
+#undef RTFetchNearest
+#undef RTCloseNearest
+#undef RTSelectDimensions
+#undef RTSelectAllocStats
+#undef RTInsertTuple
+#undef RTDeleteTuple
+#undef RTInsertBatch
+#undef RTDeleteBatch
+#undef RTUpdateTuple
+#undef RTUpdateDimensions
+#undef RTFreeTree
+#undef RTSaveTree
+#undef RTOpenMapped
+#undef RTSelectMapped
+#undef RTCloseMapped
+#undef RTOpenPaged
+#undef RTInsertPaged
+#undef RTDeletePaged
+#undef RTSelectPaged
+#undef RTSelectPageStats
+#undef RTFlushPaged
+#undef RTClosePaged
+#undef RTTrace
+#undef RTDump
+
+#undef RTREE_SPEC
+#undef RTREE_COORD
+#undef RTn
+#undef RTREE_UNSPEC
+
+#endif
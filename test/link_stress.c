@@ -0,0 +1,226 @@
+/*
+ * Stress test of RTSyncLink: writers insert, move and delete entries among a fixed set
+ * of stable ones while readers check that searches, cursors and nearest neighbour
+ * browses keep finding every stable entry exactly once
+ *
+ *   cc -std=c99 -O2 -I. -o link_stress test/link_stress.c rtree.c -lpthread
+ *   ./link_stress [rounds]
+ *
+ * Exits with failure on the first wrong answer any thread sees.
+ */
+
+#define _DEFAULT_SOURCE
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "rtree.h"
+
+#define EXTENT 100000 /*entries lie in [0, EXTENT) on every axis*/
+#define SIDE 50       /*longest side of an entry*/
+#define STABLE 20000  /*entries no writer touches*/
+#define CHURN 256     /*entries each writer inserts, moves and deletes every round*/
+#define WRITERS 4
+#define READERS 4
+#define WINDOWS 64    /*query windows the readers check*/
+#define NEAREST 10    /*K of the nearest neighbour checks*/
+
+static RTreePtr Tree;
+static struct RTEntry Stable[STABLE];
+static RTdimension Window[WINDOWS][RTn*2];
+static size_t Expected[WINDOWS];                  /*stable entries in each window*/
+static long double Nearest[WINDOWS][NEAREST];     /*distances of the stable entries nearest each window's corner*/
+static size_t Rounds = 50;
+static int Failed, Writing;
+
+static uint64_t Random(uint64_t *state);
+static void Fail(const char *what, size_t window, size_t got, size_t want);
+static bool CountStable(RTdimension I[], void *Tuple, void *ctx);
+static size_t Stables(const struct RTResults *results);
+static void NearestStable(size_t w, long double distance[]);
+static void *Writer(void *arg);
+static void *Reader(void *arg);
+
+/*xorshift64*, since rand is not thread safe*/
+static uint64_t Random(uint64_t *state) {
+   *state ^= *state >> 12;
+   *state ^= *state << 25;
+   *state ^= *state >> 27;
+   return *state * 0x2545F4914F6CDD1DULL;
+}
+
+static void Fail(const char *what, size_t window, size_t got, size_t want) {
+   if (!__atomic_exchange_n(&Failed, 1, __ATOMIC_RELAXED))
+      fprintf(stderr, "%s of window %zu: got %zu, want %zu\n", what, window, got, want);
+}
+
+/*Stable entries carry Tuples 1 to STABLE; the writers' come after them*/
+static bool CountStable(RTdimension I[], void *Tuple, void *ctx) {
+   (void)I;
+   if ((uintptr_t)Tuple <= STABLE)
+      ++*(size_t *)ctx;
+   return true;
+}
+
+static size_t Stables(const struct RTResults *results) {
+   size_t i, count = 0;
+
+   for (i = 0; i < results->Count; ++i)
+      count += (uintptr_t)results->Result[i].Tuple <= STABLE;
+   return count;
+}
+
+/*Browses from a window's corner until it has passed NEAREST stable entries*/
+static void NearestStable(size_t w, long double distance[]) {
+   struct RTResults results = {0};
+   struct RTNearest *C = NULL;
+   RTdimension P[RTn*2];
+   size_t i, k = 0, count;
+   int j;
+
+   for (j = 0; j < RTn; ++j)
+      P[j] = P[j+RTn] = Window[w][j];
+
+   RTOpenNearest(&Tree, P, NULL, NULL, &C);
+   do {
+      RTFetchNearest(C, &results, NEAREST, &count);
+      for (i = 0; i < count && k < NEAREST; ++i)
+         if ((uintptr_t)results.Result[i].Tuple <= STABLE)
+            distance[k++] = results.Result[i].Distance;
+   } while (k < NEAREST && count == NEAREST);
+
+   for (; k < NEAREST; ++k)
+      distance[k] = -1;
+   RTCloseNearest(&C);
+   RTFreeResults(&results);
+}
+
+/*Each round inserts the writer's entries, moves each within its window, and deletes them*/
+/*Every delete must find its entry, and deleting it again must not*/
+static void *Writer(void *arg) {
+   uintptr_t w = (uintptr_t)arg, first = STABLE + 1 + w * CHURN;
+   RTdimension I[CHURN][RTn*2], moved[RTn*2];
+   uint64_t state = w * 7919 + 1;
+   size_t round, i;
+   int j;
+
+   for (round = 0; round < Rounds && !__atomic_load_n(&Failed, __ATOMIC_RELAXED); ++round) {
+      for (i = 0; i < CHURN; ++i) {
+         for (j = 0; j < RTn; ++j) {
+            I[i][j] = Random(&state) % EXTENT;
+            I[i][j+RTn] = I[i][j] + Random(&state) % SIDE;
+         }
+         if (!RTInsertTuple(&Tree, I[i], (void *)(first + i)))
+            Fail("insert", w, i, CHURN);
+      }
+
+      for (i = 0; i < CHURN; ++i) {
+         for (j = 0; j < RTn; ++j) {
+            moved[j] = Random(&state) % EXTENT;
+            moved[j+RTn] = moved[j] + I[i][j+RTn] - I[i][j];
+         }
+         if (!RTUpdateDimensions(&Tree, I[i], (void *)(first + i), moved))
+            Fail("update", w, i, CHURN);
+         memcpy(I[i], moved, sizeof(moved));
+      }
+
+      for (i = 0; i < CHURN; ++i) {
+         if (!RTDeleteTuple(&Tree, I[i], (void *)(first + i)))
+            Fail("delete", w, i, CHURN);
+         if (RTDeleteTuple(&Tree, I[i], (void *)(first + i)))
+            Fail("second delete", w, i, CHURN);
+      }
+   }
+
+   __atomic_fetch_sub(&Writing, 1, __ATOMIC_RELEASE);
+   return NULL;
+}
+
+/*Checks every window by visiting search, cursor and nearest neighbour browse until the writers finish*/
+static void *Reader(void *arg) {
+   struct RTResults results = {0};
+   struct RTCursor *C;
+   long double distance[NEAREST];
+   size_t w, count, found, k;
+
+   (void)arg;
+   do {
+      for (w = 0; w < WINDOWS && !__atomic_load_n(&Failed, __ATOMIC_RELAXED); ++w) {
+         count = 0;
+         RTSelectVisit(&Tree, Window[w], CountStable, &count);
+         if (count != Expected[w])
+            Fail("search", w, count, Expected[w]);
+
+         RTOpenCursor(&Tree, Window[w], &C);
+         for (found = 0; RTFetchCursor(C, &results, 16, &count) && count; found += Stables(&results)) ;
+         RTCloseCursor(&C);
+         if (found != Expected[w])
+            Fail("cursor", w, found, Expected[w]);
+
+         NearestStable(w, distance);
+         for (k = 0; k < NEAREST; ++k)
+            if (distance[k] != Nearest[w][k])
+               Fail("nearest", w, k, NEAREST);
+      }
+   } while (__atomic_load_n(&Writing, __ATOMIC_ACQUIRE) && !__atomic_load_n(&Failed, __ATOMIC_RELAXED));
+
+   RTFreeResults(&results);
+   return NULL;
+}
+
+int main(int argc, char *argv[]) {
+   pthread_t writer[WRITERS], reader[READERS];
+   struct RTConfig config;
+   uint64_t state = 1;
+   size_t i, count;
+   int j;
+
+   if (argc > 1)
+      Rounds = (size_t)strtoul(argv[1], NULL, 10);
+
+   for (i = 0; i < STABLE; ++i) {
+      Stable[i].Tuple = (void *)(i + 1);
+      for (j = 0; j < RTn; ++j) {
+         Stable[i].I[j] = Random(&state) % EXTENT;
+         Stable[i].I[j+RTn] = Stable[i].I[j] + Random(&state) % SIDE;
+      }
+   }
+
+   memset(&config, 0, sizeof(config));
+   config.Load = RTLoadSTR;
+   config.Sync = RTSyncLink;
+   if (!RTNewTreeArray(&Tree, Stable, STABLE, &config))
+      return EXIT_FAILURE;
+
+   for (i = 0; i < WINDOWS; ++i) {
+      for (j = 0; j < RTn; ++j) {
+         Window[i][j] = Random(&state) % EXTENT;
+         Window[i][j+RTn] = Window[i][j] + EXTENT / 20;
+      }
+      RTSelectVisit(&Tree, Window[i], CountStable, &Expected[i]);
+      NearestStable(i, Nearest[i]);
+   }
+
+   Writing = WRITERS;
+   for (i = 0; i < WRITERS; ++i)
+      pthread_create(&writer[i], NULL, Writer, (void *)(uintptr_t)i);
+   for (i = 0; i < READERS; ++i)
+      pthread_create(&reader[i], NULL, Reader, NULL);
+   for (i = 0; i < WRITERS; ++i)
+      pthread_join(writer[i], NULL);
+   for (i = 0; i < READERS; ++i)
+      pthread_join(reader[i], NULL);
+
+   /*Once the writers are done only the stable entries remain*/
+   for (i = 0; i < WINDOWS; ++i) {
+      RTSelectCount(&Tree, Window[i], &count);
+      if (count != Expected[i])
+         Fail("final count", i, count, Expected[i]);
+   }
+
+   RTFreeTree(&Tree);
+   if (Failed)
+      return EXIT_FAILURE;
+   printf("%d writers, %d readers, %zu rounds of %d entries each: passed\n", WRITERS, READERS, Rounds, CHURN);
+   return 0;
+}